@@ -35,6 +35,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <stdexcept>
@@ -81,6 +82,16 @@ namespace osmium {
 
             class PBFPrimitiveBlockDecoder {
 
+            public:
+
+                /**
+                 * Called with the type and id of each object before it is
+                 * decoded, objects for which it returns false are skipped.
+                 */
+                using id_filter_type = std::function<bool(osmium::item_type, osmium::object_id_type)>;
+
+            private:
+
                 static constexpr const size_t initial_buffer_size = 2 * 1024 * 1024;
 
                 data_view m_data;
@@ -97,6 +108,33 @@ namespace osmium {
 
                 osmium::io::read_meta m_read_metadata;
 
+                // If set, nodes are decoded into these id and location
+                // arrays instead of the buffer, skipping tags and
+                // metadata.
+                std::vector<osmium::object_id_type>* m_node_ids = nullptr;
+                std::vector<osmium::Location>* m_node_locations = nullptr;
+
+                id_filter_type m_id_filter;
+
+                bool wanted(osmium::item_type type, osmium::object_id_type id) {
+                    return !m_id_filter || m_id_filter(type, id);
+                }
+
+                // Check the id of a Node, Way or Relation message, its
+                // first field, before decoding it.
+                bool wanted_message(osmium::item_type type, const data_view& data) {
+                    if (!m_id_filter) {
+                        return true;
+                    }
+                    protozero::pbf_reader pbf_message(data);
+                    osmium::object_id_type id = 0;
+                    if (pbf_message.next(1)) {
+                        // node ids are zigzag encoded, way and relation ids are not
+                        id = (type == osmium::item_type::node) ? pbf_message.get_sint64() : pbf_message.get_int64();
+                    }
+                    return m_id_filter(type, id);
+                }
+
                 void decode_stringtable(const data_view& data) {
                     if (!m_stringtable.empty()) {
                         throw osmium::pbf_error("more than one stringtable in pbf file");
@@ -145,20 +183,27 @@ namespace osmium {
                             switch (pbf_primitive_group.tag()) {
                                 case OSMFormat::PrimitiveGroup::repeated_Node_nodes:
                                     if (m_read_types & osmium::osm_entity_bits::node) {
-                                        decode_node(pbf_primitive_group.get_view());
-                                        m_buffer.commit();
+                                        if (m_node_ids) {
+                                            decode_node_location(pbf_primitive_group.get_view());
+                                        } else {
+                                            decode_node(pbf_primitive_group.get_view());
+                                            m_buffer.commit();
+                                        }
                                     } else {
                                         pbf_primitive_group.skip();
                                     }
                                     break;
                                 case OSMFormat::PrimitiveGroup::optional_DenseNodes_dense:
                                     if (m_read_types & osmium::osm_entity_bits::node) {
-                                        if (m_read_metadata == osmium::io::read_meta::yes) {
+                                        if (m_node_ids) {
+                                            decode_dense_node_locations(pbf_primitive_group.get_view());
+                                        } else if (m_read_metadata == osmium::io::read_meta::yes) {
                                             decode_dense_nodes(pbf_primitive_group.get_view());
+                                            m_buffer.commit();
                                         } else {
                                             decode_dense_nodes_without_metadata(pbf_primitive_group.get_view());
+                                            m_buffer.commit();
                                         }
-                                        m_buffer.commit();
                                     } else {
                                         pbf_primitive_group.skip();
                                     }
@@ -254,6 +299,10 @@ namespace osmium {
                 }
 
                 void decode_node(const data_view& data) {
+                    if (!wanted_message(osmium::item_type::node, data)) {
+                        return;
+                    }
+
                     osmium::builder::NodeBuilder builder{m_buffer};
                     osmium::Node& node = builder.object();
 
@@ -310,7 +359,44 @@ namespace osmium {
                     build_tag_list(builder, keys, vals);
                 }
 
+                void decode_node_location(const data_view& data) {
+                    osmium::object_id_type id = 0;
+                    int64_t lon = std::numeric_limits<int64_t>::max();
+                    int64_t lat = std::numeric_limits<int64_t>::max();
+
+                    protozero::pbf_message<OSMFormat::Node> pbf_node(data);
+                    while (pbf_node.next()) {
+                        switch (pbf_node.tag()) {
+                            case OSMFormat::Node::required_sint64_id:
+                                id = pbf_node.get_sint64();
+                                break;
+                            case OSMFormat::Node::required_sint64_lat:
+                                lat = pbf_node.get_sint64();
+                                break;
+                            case OSMFormat::Node::required_sint64_lon:
+                                lon = pbf_node.get_sint64();
+                                break;
+                            default:
+                                pbf_node.skip();
+                        }
+                    }
+
+                    m_node_ids->push_back(id);
+                    if (lon == std::numeric_limits<int64_t>::max() ||
+                        lat == std::numeric_limits<int64_t>::max()) {
+                        // deleted node in a history file
+                        m_node_locations->emplace_back();
+                    } else {
+                        m_node_locations->emplace_back(convert_pbf_coordinate(lon),
+                                                       convert_pbf_coordinate(lat));
+                    }
+                }
+
                 void decode_way(const data_view& data) {
+                    if (!wanted_message(osmium::item_type::way, data)) {
+                        return;
+                    }
+
                     osmium::builder::WayBuilder builder{m_buffer};
 
                     kv_type keys;
@@ -383,6 +469,10 @@ namespace osmium {
                 }
 
                 void decode_relation(const data_view& data) {
+                    if (!wanted_message(osmium::item_type::relation, data)) {
+                        return;
+                    }
+
                     osmium::builder::RelationBuilder builder{m_buffer};
 
                     kv_type keys;
@@ -468,6 +558,16 @@ namespace osmium {
                     }
                 }
 
+                static void skip_tag_list_from_dense_nodes(protozero::pbf_reader::const_int32_iterator& it, protozero::pbf_reader::const_int32_iterator last) {
+                    while (it != last && *it != 0) {
+                        ++it;
+                    }
+
+                    if (it != last) {
+                        ++it;
+                    }
+                }
+
                 void decode_dense_nodes_without_metadata(const data_view& data) {
                     protozero::iterator_range<protozero::pbf_reader::const_sint64_iterator> ids;
                     protozero::iterator_range<protozero::pbf_reader::const_sint64_iterator> lats;
@@ -508,16 +608,23 @@ namespace osmium {
                             throw osmium::pbf_error("PBF format error");
                         }
 
-                        osmium::builder::NodeBuilder builder{m_buffer};
-                        osmium::Node& node = builder.object();
-
-                        node.set_id(dense_id.update(ids.front()));
+                        const auto id = dense_id.update(ids.front());
                         ids.drop_front();
 
                         const auto lon = dense_longitude.update(lons.front());
                         lons.drop_front();
                         const auto lat = dense_latitude.update(lats.front());
                         lats.drop_front();
+
+                        if (!wanted(osmium::item_type::node, id)) {
+                            skip_tag_list_from_dense_nodes(tag_it, tags.end());
+                            continue;
+                        }
+
+                        osmium::builder::NodeBuilder builder{m_buffer};
+                        osmium::Node& node = builder.object();
+
+                        node.set_id(id);
                         builder.object().set_location(osmium::Location(
                                 convert_pbf_coordinate(lon),
                                 convert_pbf_coordinate(lat)
@@ -530,6 +637,85 @@ namespace osmium {
 
                 }
 
+                void decode_dense_node_locations(const data_view& data) {
+                    protozero::iterator_range<protozero::pbf_reader::const_sint64_iterator> ids;
+                    protozero::iterator_range<protozero::pbf_reader::const_sint64_iterator> lats;
+                    protozero::iterator_range<protozero::pbf_reader::const_sint64_iterator> lons;
+
+                    bool has_visibles = false;
+                    protozero::iterator_range<protozero::pbf_reader::const_int32_iterator>  visibles;
+
+                    protozero::pbf_message<OSMFormat::DenseNodes> pbf_dense_nodes(data);
+                    while (pbf_dense_nodes.next()) {
+                        switch (pbf_dense_nodes.tag()) {
+                            case OSMFormat::DenseNodes::packed_sint64_id:
+                                ids = pbf_dense_nodes.get_packed_sint64();
+                                break;
+                            case OSMFormat::DenseNodes::optional_DenseInfo_denseinfo:
+                                {
+                                    // only visibility is needed, deleted nodes having no location
+                                    protozero::pbf_message<OSMFormat::DenseInfo> pbf_dense_info = pbf_dense_nodes.get_message();
+                                    while (pbf_dense_info.next()) {
+                                        if (pbf_dense_info.tag() == OSMFormat::DenseInfo::packed_bool_visible) {
+                                            has_visibles = true;
+                                            visibles = pbf_dense_info.get_packed_bool();
+                                        } else {
+                                            pbf_dense_info.skip();
+                                        }
+                                    }
+                                }
+                                break;
+                            case OSMFormat::DenseNodes::packed_sint64_lat:
+                                lats = pbf_dense_nodes.get_packed_sint64();
+                                break;
+                            case OSMFormat::DenseNodes::packed_sint64_lon:
+                                lons = pbf_dense_nodes.get_packed_sint64();
+                                break;
+                            default:
+                                // tags are never looked at
+                                pbf_dense_nodes.skip();
+                        }
+                    }
+
+                    osmium::util::DeltaDecode<int64_t> dense_id;
+                    osmium::util::DeltaDecode<int64_t> dense_latitude;
+                    osmium::util::DeltaDecode<int64_t> dense_longitude;
+
+                    while (!ids.empty()) {
+                        if (lons.empty() ||
+                            lats.empty()) {
+                            // this is against the spec, must have same number of elements
+                            throw osmium::pbf_error("PBF format error");
+                        }
+
+                        m_node_ids->push_back(dense_id.update(ids.front()));
+                        ids.drop_front();
+
+                        const auto lon = dense_longitude.update(lons.front());
+                        lons.drop_front();
+                        const auto lat = dense_latitude.update(lats.front());
+                        lats.drop_front();
+
+                        bool visible = true;
+                        if (has_visibles) {
+                            if (visibles.empty()) {
+                                // this is against the spec, must have same number of elements
+                                throw osmium::pbf_error("PBF format error");
+                            }
+                            visible = (visibles.front() != 0);
+                            visibles.drop_front();
+                        }
+
+                        if (visible) {
+                            m_node_locations->emplace_back(convert_pbf_coordinate(lon),
+                                                           convert_pbf_coordinate(lat));
+                        } else {
+                            // deleted node in a history file
+                            m_node_locations->emplace_back();
+                        }
+                    }
+                }
+
                 void decode_dense_nodes(const data_view& data) {
                     bool has_info     = false;
                     bool has_visibles = false;
@@ -617,11 +803,49 @@ namespace osmium {
 
                         bool visible = true;
 
+                        const auto id = dense_id.update(ids.front());
+                        ids.drop_front();
+
+                        if (!wanted(osmium::item_type::node, id)) {
+                            // keep delta decoders in step with the skipped node
+                            if (has_info) {
+                                if (versions.empty() ||
+                                    changesets.empty() ||
+                                    timestamps.empty() ||
+                                    uids.empty() ||
+                                    user_sids.empty()) {
+                                    // this is against the spec, must have same number of elements
+                                    throw osmium::pbf_error("PBF format error");
+                                }
+                                versions.drop_front();
+                                dense_changeset.update(changesets.front());
+                                changesets.drop_front();
+                                dense_timestamp.update(timestamps.front());
+                                timestamps.drop_front();
+                                dense_uid.update(uids.front());
+                                uids.drop_front();
+                                dense_user_sid.update(user_sids.front());
+                                user_sids.drop_front();
+                                if (has_visibles) {
+                                    if (visibles.empty()) {
+                                        // this is against the spec, must have same number of elements
+                                        throw osmium::pbf_error("PBF format error");
+                                    }
+                                    visibles.drop_front();
+                                }
+                            }
+                            dense_longitude.update(lons.front());
+                            lons.drop_front();
+                            dense_latitude.update(lats.front());
+                            lats.drop_front();
+                            skip_tag_list_from_dense_nodes(tag_it, tags.end());
+                            continue;
+                        }
+
                         osmium::builder::NodeBuilder builder{m_buffer};
                         osmium::Node& node = builder.object();
 
-                        node.set_id(dense_id.update(ids.front()));
-                        ids.drop_front();
+                        node.set_id(id);
 
                         if (has_info) {
                             if (versions.empty() ||
@@ -695,6 +919,24 @@ namespace osmium {
                     m_read_metadata(read_metadata) {
                 }
 
+                /**
+                 * Decode nodes into the given id and location arrays
+                 * instead of the buffer returned by operator(). Only
+                 * ids and locations are decoded, tags and metadata are
+                 * skipped.
+                 */
+                void set_node_locations(std::vector<osmium::object_id_type>& ids, std::vector<osmium::Location>& locations) noexcept {
+                    m_node_ids = &ids;
+                    m_node_locations = &locations;
+                }
+
+                /**
+                 * Only decode objects accepted by the given filter.
+                 */
+                void set_id_filter(id_filter_type filter) {
+                    m_id_filter = std::move(filter);
+                }
+
                 PBFPrimitiveBlockDecoder(const PBFPrimitiveBlockDecoder&) = delete;
                 PBFPrimitiveBlockDecoder& operator=(const PBFPrimitiveBlockDecoder&) = delete;
 
@@ -559,6 +559,16 @@ namespace osmium {
                     store_primitive_block();
                 }
 
+                /**
+                 * Send objects written so far to the output queue in a
+                 * block of their own, so that data added to the queue
+                 * afterwards comes after them.
+                 */
+                void flush() {
+                    store_primitive_block();
+                    m_primitive_block.reset(OSMFormat::PrimitiveGroup::unknown);
+                }
+
                 void node(const osmium::Node& node) {
                     if (m_options.use_dense_nodes) {
                         switch_primitive_block_type(OSMFormat::PrimitiveGroup::optional_DenseNodes_dense);
@@ -0,0 +1,184 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../../include/rapidjson/document.h"
+#include "../cell_covering.h"
+#include "../geojson.h"
+#include "../polygon_index.h"
+#include "../polygon_set.h"
+
+// Compare spatial index backends on geojson files and synthetic
+// polygon sets: build time, memory and queries per second, a query
+// being the location check done for each node without cache.
+
+constexpr std::size_t locations_number = 200000;
+
+// Level of the cells classified for each location, as when checking
+// nodes.
+constexpr unsigned cell_level = 16;
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start){
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static std::string json_point(double x, double y){
+  return "[" + std::to_string(x) + "," + std::to_string(y) + "]";
+}
+
+static void add_polygon(polygon_set& polygons,
+                        const std::string& name,
+                        const std::string& rings){
+  rapidjson::Document json;
+  json.Parse(rings.c_str());
+  polygons.add_polygon(name, json);
+}
+
+// Grid of small squares, every third one with a triangular hole.
+static polygon_set tiles(int side){
+  polygon_set polygons;
+  for(int i = 0; i < side; ++i){
+    for(int j = 0; j < side; ++j){
+      const double x = 13.0 + 0.01 * i;
+      const double y = 52.3 + 0.01 * j;
+      std::string rings = "[[" + json_point(x, y) + "," + json_point(x + 0.008, y)
+        + "," + json_point(x + 0.008, y + 0.008) + "," + json_point(x, y + 0.008)
+        + "," + json_point(x, y) + "]";
+      if((i + j) % 3 == 0){
+        rings += ",[" + json_point(x + 0.002, y + 0.002)
+          + "," + json_point(x + 0.002, y + 0.006)
+          + "," + json_point(x + 0.006, y + 0.002)
+          + "," + json_point(x + 0.002, y + 0.002) + "]";
+      }
+      add_polygon(polygons, "tile", rings + "]");
+    }
+  }
+  return polygons;
+}
+
+// Long thin diagonal strips, whose bounding boxes overlap a lot.
+static polygon_set strips(int number){
+  polygon_set polygons;
+  for(int i = 0; i < number; ++i){
+    const double x = 13.0 + 0.005 * i;
+    const double y = 52.3;
+    add_polygon(polygons,
+                "strip",
+                "[[" + json_point(x, y) + "," + json_point(x + 0.002, y)
+                + "," + json_point(x + 0.502, y + 0.5)
+                + "," + json_point(x + 0.5, y + 0.5)
+                + "," + json_point(x, y) + "]]");
+  }
+  return polygons;
+}
+
+// Single star-shaped polygon with many vertices.
+static polygon_set star(int vertices){
+  polygon_set polygons;
+  std::string ring;
+  for(int i = 0; i <= vertices; ++i){
+    const double angle = 2 * M_PI * (i % vertices) / vertices;
+    const double radius = (i % 2 == 0) ? 0.5 : 0.3 + 0.1 * std::sin(0.01 * i);
+    ring += ((i == 0) ? "" : ",")
+      + json_point(13.4 + radius * std::cos(angle), 52.5 + radius * std::sin(angle));
+  }
+  add_polygon(polygons, "star", "[[" + ring + "]]");
+  return polygons;
+}
+
+static void run(const std::string& set_name, const polygon_set& polygons){
+  // Random locations in the extent of all polygons, with a margin.
+  osmium::Box extent;
+  for(std::size_t p = 0; p < polygons.size(); ++p){
+    extent.extend(polygons.bbox(p));
+  }
+  const int64_t width = static_cast<int64_t>(extent.top_right().x()) - extent.bottom_left().x();
+  const int64_t height = static_cast<int64_t>(extent.top_right().y()) - extent.bottom_left().y();
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int64_t> x_coordinate(extent.bottom_left().x() - width / 10,
+                                                      extent.top_right().x() + width / 10);
+  std::uniform_int_distribution<int64_t> y_coordinate(extent.bottom_left().y() - height / 10,
+                                                      extent.top_right().y() + height / 10);
+  std::vector<osmium::Location> locations;
+  for(std::size_t i = 0; i < locations_number; ++i){
+    locations.emplace_back(static_cast<int32_t>(x_coordinate(gen)),
+                           static_cast<int32_t>(y_coordinate(gen)));
+  }
+
+  std::cout << set_name << ": " << polygons.size() << " polygon(s)\n";
+  for(const auto& name: index_names()){
+    const auto build_start = bench_clock::now();
+    const auto index = make_index(name, polygons);
+    const double build_time = seconds_since(build_start);
+
+    std::vector<uint32_t> ranks;
+    std::size_t inside = 0;
+    const auto query_start = bench_clock::now();
+    for(const auto& loc: locations){
+      switch(index->classify(cell_covering::cell_box(loc, cell_level), ranks)){
+      case box_position::inside:
+        ++inside;
+        break;
+      case box_position::outside:
+        break;
+      case box_position::boundary:
+        if(index->contains(loc, ranks)){
+          ++inside;
+        }
+        break;
+      }
+    }
+    const double query_time = seconds_since(query_start);
+
+    std::cout << "  " << std::left << std::setw(9) << name << std::right
+              << " build: " << std::setw(8) << std::fixed << std::setprecision(1)
+              << 1000 * build_time << "ms"
+              << "  memory: " << std::setw(8) << index->memory() / 1024.0 << "KB"
+              << "  queries: " << std::setw(10) << std::setprecision(0)
+              << locations.size() / query_time << "/s"
+              << "  inside: " << inside << "\n";
+  }
+}
+
+int main(int argc, char* argv[]){
+  std::vector<std::string> files;
+  for(int i = 1; i < argc; ++i){
+    files.push_back(argv[i]);
+  }
+  if(files.empty()){
+    files = {"files/berlin_heart.geojson",
+             "files/berlin_ring.geojson",
+             "files/berlin_flower.geojson"};
+  }
+
+  for(const auto& file: files){
+    polygon_set polygons;
+    std::string error_msg;
+    if(!read_polygons(file, polygons, error_msg)){
+      std::cout << file << ": " << error_msg << std::endl;
+      return 1;
+    }
+    if(!polygons.empty()){
+      run(file, polygons);
+    }
+  }
+
+  run("synthetic tiles", tiles(100));
+  run("synthetic strips", strips(200));
+  run("synthetic star", star(100000));
+  return 0;
+}
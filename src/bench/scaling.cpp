@@ -0,0 +1,192 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <osmium/builder/attr.hpp>
+#include <osmium/io/any_input.hpp>
+#include "../geojson.h"
+#include "../id_set.h"
+#include "../node_checker.h"
+#include "../polygon_index.h"
+#include "../polygon_set.h"
+
+// Measure how node checks scale with the number of threads, on nodes
+// read from an OSM file or on synthetic nodes. The osmium pool size
+// is fixed on first use, so each thread count runs in its own process
+// with a pool of that size.
+
+constexpr unsigned max_threads = 32;
+
+constexpr std::size_t synthetic_nodes = 4000000;
+constexpr std::size_t nodes_per_buffer = 8000;
+
+// Synthetic nodes come in clusters, as consecutive nodes in OSM files
+// are usually close to each other.
+constexpr std::size_t cluster_size = 100;
+constexpr int32_t cluster_radius = 100000;
+
+typedef std::vector<std::shared_ptr<const osmium::memory::Buffer>> buffers_t;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Result of a run, sent back from the child process.
+struct run_result{
+  std::size_t buffers;
+  double time;
+  uint64_t nodes;
+  std::size_t inside;
+};
+
+static buffers_t read_nodes(const std::string& file_name){
+  buffers_t buffers;
+  osmium::io::Reader reader(file_name, osmium::osm_entity_bits::node);
+  while(osmium::memory::Buffer buffer = reader.read()){
+    buffers.push_back(std::make_shared<const osmium::memory::Buffer>(std::move(buffer)));
+  }
+  reader.close();
+  return buffers;
+}
+
+static buffers_t synthetic(const polygon_set& polygons){
+  using namespace osmium::builder::attr;
+  osmium::Box extent;
+  for(std::size_t p = 0; p < polygons.size(); ++p){
+    extent.extend(polygons.bbox(p));
+  }
+  const int64_t width = static_cast<int64_t>(extent.top_right().x()) - extent.bottom_left().x();
+  const int64_t height = static_cast<int64_t>(extent.top_right().y()) - extent.bottom_left().y();
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int64_t> x_coordinate(extent.bottom_left().x() - width / 10,
+                                                      extent.top_right().x() + width / 10);
+  std::uniform_int_distribution<int64_t> y_coordinate(extent.bottom_left().y() - height / 10,
+                                                      extent.top_right().y() + height / 10);
+  std::uniform_int_distribution<int32_t> offset(-cluster_radius, cluster_radius);
+
+  buffers_t buffers;
+  std::shared_ptr<osmium::memory::Buffer> buffer;
+  int64_t x = 0;
+  int64_t y = 0;
+  for(std::size_t i = 0; i < synthetic_nodes; ++i){
+    if(i % nodes_per_buffer == 0){
+      buffer = std::make_shared<osmium::memory::Buffer>(nodes_per_buffer * 64);
+      buffers.push_back(buffer);
+    }
+    if(i % cluster_size == 0){
+      x = x_coordinate(gen);
+      y = y_coordinate(gen);
+    }
+    const osmium::Location loc(static_cast<int32_t>(x + offset(gen)),
+                               static_cast<int32_t>(y + offset(gen)));
+    osmium::builder::add_node(*buffer,
+                              _id(static_cast<osmium::object_id_type>(i + 1)),
+                              _location(loc));
+  }
+  return buffers;
+}
+
+// Check all nodes in a child process whose pool has the given number
+// of threads, reading an OSM file there as it starts the pool too.
+static bool run(const polygon_set& polygons,
+                const polygon_index& index,
+                const char* osm_name,
+                unsigned threads,
+                run_result& result){
+  int fds[2];
+  if(pipe(fds) != 0){
+    return false;
+  }
+  std::cout.flush();
+  const pid_t pid = fork();
+  if(pid < 0){
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if(pid == 0){
+    close(fds[0]);
+    setenv("OSMIUM_POOL_THREADS", std::to_string(threads).c_str(), 1);
+    const buffers_t buffers = osm_name ? read_nodes(osm_name) : synthetic(polygons);
+    const auto inside_nodes = make_id_set("auto");
+    const auto start = bench_clock::now();
+    parallel_node_checker checker(polygons, index, *inside_nodes, threads);
+    for(const auto& buffer: buffers){
+      checker.check(buffer);
+    }
+    checker.wait();
+    const run_result child_result{buffers.size(),
+                                  std::chrono::duration<double>(bench_clock::now() - start).count(),
+                                  checker.statistics().nodes,
+                                  inside_nodes->size()};
+    const bool written
+      = (write(fds[1], &child_result, sizeof(child_result)) == sizeof(child_result));
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  const bool read_ok = (read(fds[0], &result, sizeof(result)) == sizeof(result));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return read_ok and WIFEXITED(status) and (WEXITSTATUS(status) == 0);
+}
+
+int main(int argc, char* argv[]){
+  if((argc > 3) or ((argc > 1) and (std::string(argv[1]) == "-h"))){
+    std::cout << "Usage : osmium-polygon-scaling [GEOJSON_FILE [OSM_FILE]]\n";
+    return 0;
+  }
+
+  const std::string poly_name = (argc > 1) ? argv[1] : "files/berlin_flower.geojson";
+  polygon_set polygons;
+  std::string error_msg;
+  if(!read_polygons(poly_name, polygons, error_msg)){
+    std::cout << poly_name << ": " << error_msg << std::endl;
+    return 1;
+  }
+  if(polygons.empty()){
+    std::cout << poly_name << ": no polygon" << std::endl;
+    return 1;
+  }
+
+  const char* osm_name = (argc > 2) ? argv[2] : nullptr;
+  const auto index = make_index("rtree", polygons);
+  std::cout << poly_name << ", "
+            << (osm_name ? osm_name : "synthetic nodes") << "\n";
+
+  double single_thread_time = 0;
+  for(unsigned threads = 1; threads <= max_threads; threads *= 2){
+    run_result result;
+    if(!run(polygons, *index, osm_name, threads, result)){
+      std::cout << "  pool threads: " << threads << "  failed\n";
+      return 1;
+    }
+    if(threads == 1){
+      single_thread_time = result.time;
+      std::cout << "  " << result.buffers << " buffers\n";
+    }
+
+    std::cout << "  pool threads: " << std::setw(2) << threads
+              << "  time: " << std::setw(8) << std::fixed << std::setprecision(1)
+              << 1000 * result.time << "ms"
+              << "  nodes: " << std::setw(10) << std::setprecision(0)
+              << result.nodes / result.time << "/s"
+              << "  speedup: " << std::setprecision(2)
+              << single_thread_time / result.time
+              << "  inside: " << result.inside << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "box_grid.h"
+
+// Maximum number of cells along each side of the grid.
+constexpr uint32_t max_grid_side = 1024;
+
+box_grid::box_grid():
+  _min_x(0),
+  _min_y(0),
+  _max_x(0),
+  _max_y(0),
+  _cell_width(1),
+  _cell_height(1),
+  _columns(0),
+  _rows(0){}
+
+box_grid::box_grid(const osmium::Box& extent,
+                   const std::vector<osmium::Box>& boxes,
+                   uint32_t first,
+                   uint32_t last):
+  _min_x(extent.bottom_left().x()),
+  _min_y(extent.bottom_left().y()),
+  _max_x(extent.top_right().x()),
+  _max_y(extent.top_right().y()){
+  // About one cell per box.
+  const uint32_t side
+    = std::min(max_grid_side,
+               static_cast<uint32_t>(std::ceil(std::sqrt(last - first))));
+
+  const int64_t width = static_cast<int64_t>(_max_x) - _min_x;
+  const int64_t height = static_cast<int64_t>(_max_y) - _min_y;
+  _cell_width = width / side + 1;
+  _cell_height = height / side + 1;
+  _columns = static_cast<uint32_t>(width / _cell_width + 1);
+  _rows = static_cast<uint32_t>(height / _cell_height + 1);
+
+  // Counting pass then filling pass to store box lists
+  // contiguously.
+  auto for_each_cell = [&](const osmium::Box& box, auto&& f){
+    const uint32_t last_row = row(std::min(box.top_right().y(), _max_y));
+    const uint32_t last_column = column(std::min(box.top_right().x(), _max_x));
+    for(uint32_t r = row(std::max(box.bottom_left().y(), _min_y));
+        r <= last_row;
+        ++r){
+      for(uint32_t c = column(std::max(box.bottom_left().x(), _min_x));
+          c <= last_column;
+          ++c){
+        f(r * _columns + c);
+      }
+    }
+  };
+
+  _box_offsets.assign(_columns * _rows + 1, 0);
+  for(uint32_t i = first; i < last; ++i){
+    for_each_cell(boxes[i], [&](std::size_t cell){
+        ++_box_offsets[cell + 1];
+      });
+  }
+  std::partial_sum(_box_offsets.begin(),
+                   _box_offsets.end(),
+                   _box_offsets.begin());
+
+  std::vector<uint32_t> positions(_box_offsets.begin(),
+                                  _box_offsets.end() - 1);
+  _boxes.resize(_box_offsets.back());
+  for(uint32_t i = first; i < last; ++i){
+    for_each_cell(boxes[i], [&](std::size_t cell){
+        _boxes[positions[cell]++] = i;
+      });
+  }
+}
+
+uint32_t box_grid::column(int32_t x) const{
+  return static_cast<uint32_t>((static_cast<int64_t>(x) - _min_x) / _cell_width);
+}
+
+uint32_t box_grid::row(int32_t y) const{
+  return static_cast<uint32_t>((static_cast<int64_t>(y) - _min_y) / _cell_height);
+}
+
+bool box_grid::empty() const{
+  return _box_offsets.empty();
+}
+
+std::size_t box_grid::memory() const{
+  return (_box_offsets.capacity() + _boxes.capacity()) * sizeof(uint32_t);
+}
+
+std::pair<const uint32_t*, const uint32_t*>
+box_grid::candidates(const osmium::Location& loc) const{
+  if((loc.x() < _min_x) or (loc.x() > _max_x)
+     or (loc.y() < _min_y) or (loc.y() > _max_y)){
+    return std::make_pair(nullptr, nullptr);
+  }
+  const std::size_t cell = row(loc.y()) * _columns + column(loc.x());
+  return std::make_pair(_boxes.data() + _box_offsets[cell],
+                        _boxes.data() + _box_offsets[cell + 1]);
+}
+
+void box_grid::candidates(const osmium::Box& box,
+                          std::vector<uint32_t>& ranks) const{
+  if((box.top_right().x() < _min_x) or (box.bottom_left().x() > _max_x)
+     or (box.top_right().y() < _min_y) or (box.bottom_left().y() > _max_y)){
+    return;
+  }
+  const std::size_t first = ranks.size();
+  const uint32_t first_column = column(std::max(box.bottom_left().x(), _min_x));
+  const uint32_t last_column = column(std::min(box.top_right().x(), _max_x));
+  const uint32_t first_row = row(std::max(box.bottom_left().y(), _min_y));
+  const uint32_t last_row = row(std::min(box.top_right().y(), _max_y));
+  for(uint32_t r = first_row; r <= last_row; ++r){
+    for(uint32_t c = first_column; c <= last_column; ++c){
+      const std::size_t cell = r * _columns + c;
+      ranks.insert(ranks.end(),
+                   _boxes.begin() + _box_offsets[cell],
+                   _boxes.begin() + _box_offsets[cell + 1]);
+    }
+  }
+  // Boxes overlapping several cells are listed several times.
+  std::sort(ranks.begin() + first, ranks.end());
+  ranks.erase(std::unique(ranks.begin() + first, ranks.end()), ranks.end());
+}
@@ -0,0 +1,65 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef BOX_GRID_H
+#define BOX_GRID_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+
+// Uniform grid over an extent, each cell listing the boxes that
+// overlap it. Boxes are identified by their rank in the vector they
+// are indexed from, e.g. inner rings of a polygon or polygons of a
+// set.
+class box_grid{
+private:
+  int32_t _min_x;
+  int32_t _min_y;
+  int32_t _max_x;
+  int32_t _max_y;
+  int64_t _cell_width;
+  int64_t _cell_height;
+  uint32_t _columns;
+  uint32_t _rows;
+
+  std::vector<uint32_t> _box_offsets;
+  std::vector<uint32_t> _boxes;
+
+  uint32_t column(int32_t x) const;
+
+  uint32_t row(int32_t y) const;
+
+public:
+  box_grid();
+
+  // Index boxes in [first, last) of boxes, over extent.
+  box_grid(const osmium::Box& extent,
+           const std::vector<osmium::Box>& boxes,
+           uint32_t first,
+           uint32_t last);
+
+  bool empty() const;
+
+  // Approximate heap memory used, in bytes.
+  std::size_t memory() const;
+
+  // Range of boxes that may contain loc.
+  std::pair<const uint32_t*, const uint32_t*>
+  candidates(const osmium::Location& loc) const;
+
+  // Append to ranks the boxes that may overlap box, without
+  // duplicates.
+  void candidates(const osmium::Box& box,
+                  std::vector<uint32_t>& ranks) const;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include "cell_covering.h"
+
+// Deepest level used, leaf cells being at least 16 units wide.
+constexpr unsigned max_level = 28;
+
+// Refining stops before the number of boundary cells may exceed this
+// value.
+constexpr std::size_t max_boundary_cells = 1 << 18;
+
+// Spread the 32 bits of value on even bit positions.
+static uint64_t spread_bits(uint32_t value){
+  uint64_t bits = value;
+  bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFULL;
+  bits = (bits | (bits << 8)) & 0x00FF00FF00FF00FFULL;
+  bits = (bits | (bits << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+  bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+  return bits;
+}
+
+static uint64_t morton_key(uint32_t x, uint32_t y){
+  return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+// Coordinate value for an unsigned shifted coordinate.
+static int32_t coordinate(uint64_t value){
+  return static_cast<int32_t>(static_cast<int64_t>(value)
+                              + std::numeric_limits<int32_t>::min());
+}
+
+// Unsigned shifted coordinate for a coordinate value.
+static uint32_t shifted(int32_t value){
+  return static_cast<uint32_t>(static_cast<int64_t>(value)
+                               - std::numeric_limits<int32_t>::min());
+}
+
+// Cell to refine, with candidate polygons in [first, last) of a
+// shared rank vector.
+struct frontier_cell{
+  uint32_t x;
+  uint32_t y;
+  uint32_t first;
+  uint32_t last;
+};
+
+cell_covering::cell_covering():
+  _polygons(nullptr),
+  _interior_cells(0){}
+
+cell_covering::cell_covering(const polygon_set& polygons):
+  _polygons(&polygons),
+  _interior_cells(0){
+  // Leaves in creation order, sorted by key afterwards.
+  std::vector<uint64_t> first_keys;
+  std::vector<uint64_t> last_keys;
+  std::vector<bool> interior;
+  std::vector<uint32_t> rank_offsets(1, 0);
+  std::vector<uint32_t> ranks;
+
+  auto add_leaf = [&](uint64_t x,
+                      uint64_t y,
+                      uint64_t side,
+                      bool is_interior,
+                      const uint32_t* first_rank,
+                      const uint32_t* last_rank){
+    const uint64_t first_key = morton_key(x, y);
+    first_keys.push_back(first_key);
+    // Wraps around to the maximum key for the root cell.
+    last_keys.push_back(first_key + side * side - 1);
+    interior.push_back(is_interior);
+    ranks.insert(ranks.end(), first_rank, last_rank);
+    rank_offsets.push_back(ranks.size());
+  };
+
+  // Start with the root cell, all polygons being candidates.
+  std::vector<frontier_cell> frontier;
+  std::vector<uint32_t> candidates(polygons.size());
+  std::iota(candidates.begin(), candidates.end(), 0);
+  frontier.push_back({0, 0, 0, static_cast<uint32_t>(candidates.size())});
+
+  std::vector<frontier_cell> next_frontier;
+  std::vector<uint32_t> next_candidates;
+
+  for(unsigned level = 0; !frontier.empty(); ++level){
+    const uint64_t side = uint64_t(1) << (32 - level);
+
+    if((level == max_level)
+       or (4 * frontier.size() > max_boundary_cells)){
+      // Remaining cells are boundary leaves.
+      for(const auto& cell: frontier){
+        add_leaf(cell.x,
+                 cell.y,
+                 side,
+                 false,
+                 candidates.data() + cell.first,
+                 candidates.data() + cell.last);
+      }
+      break;
+    }
+
+    // Split each cell in four and classify children with regard to
+    // the candidate polygons of their parent.
+    const uint64_t half = side / 2;
+    next_frontier.clear();
+    next_candidates.clear();
+    for(const auto& cell: frontier){
+      for(unsigned q = 0; q < 4; ++q){
+        const uint64_t x = cell.x + ((q & 1) ? half : 0);
+        const uint64_t y = cell.y + ((q & 2) ? half : 0);
+        const osmium::Box box(osmium::Location(coordinate(x),
+                                               coordinate(y)),
+                              osmium::Location(coordinate(x + half - 1),
+                                               coordinate(y + half - 1)));
+
+        const uint32_t first = next_candidates.size();
+        bool is_interior = false;
+        for(uint32_t c = cell.first; (c < cell.last) and !is_interior; ++c){
+          const uint32_t rank = candidates[c];
+          switch(polygons.classify(rank, box)){
+          case box_position::inside:
+            add_leaf(x, y, half, true, &rank, &rank + 1);
+            is_interior = true;
+            break;
+          case box_position::boundary:
+            next_candidates.push_back(rank);
+            break;
+          case box_position::outside:
+            break;
+          }
+        }
+
+        if(is_interior){
+          next_candidates.resize(first);
+        }
+        else if(next_candidates.size() > first){
+          next_frontier.push_back({static_cast<uint32_t>(x),
+                                   static_cast<uint32_t>(y),
+                                   first,
+                                   static_cast<uint32_t>(next_candidates.size())});
+        }
+      }
+    }
+    std::swap(frontier, next_frontier);
+    std::swap(candidates, next_candidates);
+  }
+
+  // Store leaves sorted by key.
+  std::vector<std::size_t> order(first_keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(),
+            order.end(),
+            [&](auto lhs, auto rhs){
+              return first_keys[lhs] < first_keys[rhs];
+            });
+
+  _rank_offsets.push_back(0);
+  for(auto i: order){
+    _first_keys.push_back(first_keys[i]);
+    _last_keys.push_back(last_keys[i]);
+    _interior.push_back(interior[i]);
+    if(interior[i]){
+      ++_interior_cells;
+    }
+    _ranks.insert(_ranks.end(),
+                  ranks.begin() + rank_offsets[i],
+                  ranks.begin() + rank_offsets[i + 1]);
+    _rank_offsets.push_back(_ranks.size());
+  }
+}
+
+uint64_t cell_covering::key(const osmium::Location& loc){
+  return morton_key(shifted(loc.x()), shifted(loc.y()));
+}
+
+osmium::Box cell_covering::cell_box(const osmium::Location& loc,
+                                   unsigned level){
+  const unsigned shift = 32 - level;
+  const uint64_t x = (static_cast<uint64_t>(shifted(loc.x())) >> shift) << shift;
+  const uint64_t y = (static_cast<uint64_t>(shifted(loc.y())) >> shift) << shift;
+  const uint64_t side = uint64_t(1) << shift;
+  return osmium::Box(osmium::Location(coordinate(x), coordinate(y)),
+                     osmium::Location(coordinate(x + side - 1),
+                                      coordinate(y + side - 1)));
+}
+
+bool cell_covering::empty() const{
+  return _first_keys.empty();
+}
+
+std::size_t cell_covering::size() const{
+  return _first_keys.size();
+}
+
+std::size_t cell_covering::interior_cells() const{
+  return _interior_cells;
+}
+
+std::size_t cell_covering::memory() const{
+  return (_first_keys.capacity() + _last_keys.capacity()) * sizeof(uint64_t)
+    + _interior.capacity() / 8
+    + (_rank_offsets.capacity() + _ranks.capacity()) * sizeof(uint32_t);
+}
+
+bool cell_covering::contains(const osmium::Location& loc) const{
+  const uint64_t loc_key = key(loc);
+  const auto next = std::upper_bound(_first_keys.begin(),
+                                     _first_keys.end(),
+                                     loc_key);
+  if(next == _first_keys.begin()){
+    return false;
+  }
+  const std::size_t leaf = next - _first_keys.begin() - 1;
+  if(loc_key > _last_keys[leaf]){
+    // Not covered, hence out of all polygons.
+    return false;
+  }
+  if(_interior[leaf]){
+    return true;
+  }
+  for(uint32_t r = _rank_offsets[leaf]; r < _rank_offsets[leaf + 1]; ++r){
+    if(_polygons->contains(_ranks[r], loc)){
+      return true;
+    }
+  }
+  return false;
+}
+
+box_position cell_covering::classify(const osmium::Box& box) const{
+  uint64_t first_key = key(box.bottom_left());
+  uint64_t last_key = key(box.top_right());
+  // Widen the key range to the smallest cell containing box.
+  const uint64_t different_bits = first_key ^ last_key;
+  if(different_bits != 0){
+    unsigned bits = 64 - __builtin_clzll(different_bits);
+    bits += bits % 2;
+    const uint64_t mask = (bits == 64) ? std::numeric_limits<uint64_t>::max()
+                                       : (uint64_t(1) << bits) - 1;
+    first_key &= ~mask;
+    last_key |= mask;
+  }
+
+  const auto next = std::upper_bound(_first_keys.begin(),
+                                     _first_keys.end(),
+                                     first_key);
+  if(next != _first_keys.begin()){
+    const std::size_t leaf = next - _first_keys.begin() - 1;
+    if(_last_keys[leaf] >= first_key){
+      // Leaves are cells of the same hierarchy, so this one either
+      // contains the whole range or is one of several leaves in it.
+      return (_interior[leaf] and (last_key <= _last_keys[leaf])) ?
+        box_position::inside : box_position::boundary;
+    }
+  }
+  if((next != _first_keys.end()) and (*next <= last_key)){
+    return box_position::boundary;
+  }
+  return box_position::outside;
+}
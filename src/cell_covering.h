@@ -0,0 +1,70 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef CELL_COVERING_H
+#define CELL_COVERING_H
+
+#include <cstdint>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include "polygon_set.h"
+
+// Linear quadtree covering a set of polygons. The int32 location
+// space is recursively split in four, cells being identified by the
+// range of Morton keys of the locations they contain. Leaf cells
+// either lie in a polygon or are crossed by polygon boundaries, in
+// which case they list the polygons to check exactly. Leaves are
+// stored sorted by key so finding the cell of a location is a binary
+// search.
+class cell_covering{
+private:
+  const polygon_set* _polygons;
+
+  // Leaf i spans Morton keys in [_first_keys[i], _last_keys[i]].
+  std::vector<uint64_t> _first_keys;
+  std::vector<uint64_t> _last_keys;
+
+  // Polygon ranks for each leaf: the polygon containing the cell for
+  // interior leaves, candidate polygons for boundary leaves.
+  std::vector<bool> _interior;
+  std::vector<uint32_t> _rank_offsets;
+  std::vector<uint32_t> _ranks;
+
+  std::size_t _interior_cells;
+
+public:
+  cell_covering();
+
+  cell_covering(const polygon_set& polygons);
+
+  // Interleave bits of the unsigned shifted coordinates, x bits
+  // being on even positions.
+  static uint64_t key(const osmium::Location& loc);
+
+  // Box of the cell at level containing loc.
+  static osmium::Box cell_box(const osmium::Location& loc, unsigned level);
+
+  bool empty() const;
+
+  std::size_t size() const;
+
+  std::size_t interior_cells() const;
+
+  // Approximate heap memory used, in bytes.
+  std::size_t memory() const;
+
+  bool contains(const osmium::Location& loc) const;
+
+  // Inclusion status of box in the union of polygons, based on the
+  // leaves overlapping the smallest cell containing box.
+  box_position classify(const osmium::Box& box) const;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "geojson.h"
+#include "../include/rapidjson/document.h"
+#include "../include/rapidjson/error/en.h"
+
+// Parse file and check it has a features array.
+static bool parse(const std::string& file_name,
+                  rapidjson::Document& json_input,
+                  std::string& error_msg){
+  std::ifstream ifs (file_name);
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+
+  if(json_input.Parse(buffer.str().c_str()).HasParseError()){
+    error_msg = std::string(rapidjson::GetParseError_En(json_input.GetParseError()))
+      + " (offset: "
+      + std::to_string(json_input.GetErrorOffset())
+      + ")";
+    return false;
+  }
+
+  if(!json_input.HasMember("features")
+     or !json_input["features"].IsArray()){
+    error_msg = "[error] Invalid \"features\" key.";
+    return false;
+  }
+  return true;
+}
+
+static bool is_polygon_feature(const rapidjson::Value& feature){
+  return feature.HasMember("geometry")
+    and feature["geometry"].HasMember("type")
+    and feature["geometry"]["type"].IsString()
+    and (feature["geometry"]["type"] == "Polygon"
+         or feature["geometry"]["type"] == "MultiPolygon")
+    and feature["geometry"].HasMember("coordinates")
+    and feature["geometry"]["coordinates"].IsArray();
+}
+
+// Add polygons of feature i to polygons.
+static void add_feature(const rapidjson::Value& feature,
+                        rapidjson::SizeType i,
+                        polygon_set& polygons){
+  std::vector<std::string> name_keys({"name", "id", "ID"});
+
+  std::string current_name;
+  if(feature.HasMember("properties")){
+    for(const auto& name: name_keys){
+      if(feature["properties"].HasMember(name.c_str())
+         and feature["properties"][name.c_str()].IsString()){
+        // Using property name.
+        current_name = feature["properties"][name.c_str()].GetString();
+        break;
+      }
+    }
+  }
+  if(current_name.empty()){
+    // Default to feature index.
+    current_name = "feature_" + std::to_string(i);
+  }
+
+  if(feature["geometry"]["type"] == "Polygon"){
+    polygons.add_polygon(current_name,
+                         feature["geometry"]["coordinates"]);
+  }
+  if(feature["geometry"]["type"] == "MultiPolygon"){
+    auto& coordinates = feature["geometry"]["coordinates"];
+    for(rapidjson::SizeType i = 0; i < coordinates.Size(); ++i){
+      polygons.add_polygon(current_name + "_" + std::to_string(i),
+                           coordinates[i]);
+    }
+  }
+}
+
+bool read_polygons(const std::string& file_name,
+                   polygon_set& polygons,
+                   std::string& error_msg){
+  rapidjson::Document json_input;
+  if(!parse(file_name, json_input, error_msg)){
+    return false;
+  }
+
+  // Finding the polygon features in the json file.
+  for(rapidjson::SizeType i = 0; i < json_input["features"].Size(); ++i){
+    auto& feature = json_input["features"][i];
+    if(is_polygon_feature(feature)){
+      add_feature(feature, i, polygons);
+    }
+  }
+  return true;
+}
+
+bool read_extracts(const std::string& file_name,
+                   std::vector<std::string>& outputs,
+                   std::vector<std::unique_ptr<polygon_set>>& polygon_sets,
+                   std::string& error_msg){
+  rapidjson::Document json_input;
+  if(!parse(file_name, json_input, error_msg)){
+    return false;
+  }
+
+  for(rapidjson::SizeType i = 0; i < json_input["features"].Size(); ++i){
+    auto& feature = json_input["features"][i];
+    if(!is_polygon_feature(feature)){
+      continue;
+    }
+    if(!feature.HasMember("properties")
+       or !feature["properties"].HasMember("output")
+       or !feature["properties"]["output"].IsString()){
+      error_msg = "[error] Missing \"output\" property for feature "
+        + std::to_string(i) + ".";
+      return false;
+    }
+    const std::string output = feature["properties"]["output"].GetString();
+    const auto search = std::find(outputs.begin(), outputs.end(), output);
+    const std::size_t e = search - outputs.begin();
+    if(search == outputs.end()){
+      outputs.push_back(output);
+      polygon_sets.emplace_back(new polygon_set());
+    }
+    add_feature(feature, i, *polygon_sets[e]);
+  }
+  return true;
+}
@@ -0,0 +1,34 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef GEOJSON_H
+#define GEOJSON_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "polygon_set.h"
+
+// Add all Polygon and MultiPolygon features of a geojson file to
+// polygons. Return false with an error message if the file can not
+// be parsed.
+bool read_polygons(const std::string& file_name,
+                   polygon_set& polygons,
+                   std::string& error_msg);
+
+// Group Polygon and MultiPolygon features of a geojson file in one
+// polygon set per value of their "output" property, in order of first
+// appearance. Return false with an error message if the file can not
+// be parsed or a feature has no output.
+bool read_extracts(const std::string& file_name,
+                   std::vector<std::string>& outputs,
+                   std::vector<std::unique_ptr<polygon_set>>& polygon_sets,
+                   std::string& error_msg);
+
+#endif
@@ -0,0 +1,522 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <limits>
+#include "id_set.h"
+
+// Ids per chunk and chunk size for dense bitsets.
+constexpr unsigned dense_chunk_bits = 25;
+constexpr uint64_t dense_chunk_mask = (uint64_t(1) << dense_chunk_bits) - 1;
+constexpr std::size_t dense_chunk_words = std::size_t(1) << (dense_chunk_bits - 6);
+constexpr std::size_t dense_chunk_bytes = dense_chunk_words * sizeof(uint64_t);
+
+// Number of ids ahead of the current one whose memory is prefetched
+// in batch lookups.
+constexpr std::size_t prefetch_distance = 16;
+
+// Maximum number of values in an array container, above which a
+// bitmap is smaller.
+constexpr std::size_t max_array_size = 4096;
+
+constexpr std::size_t bitmap_words = 1024;
+
+// Dense bitsets are selected if they use at most that many times the
+// memory of compressed ones, bitmap containers being about as large
+// as the matching dense chunks.
+constexpr std::size_t dense_memory_factor = 2;
+
+// Ids mapped to unsigned values with the same order.
+static uint64_t unsigned_id(osmium::object_id_type id){
+  return static_cast<uint64_t>(id) ^ (uint64_t(1) << 63);
+}
+
+static osmium::object_id_type signed_id(uint64_t value){
+  return static_cast<osmium::object_id_type>(value ^ (uint64_t(1) << 63));
+}
+
+static uint64_t magnitude(osmium::object_id_type id){
+  return (id >= 0) ? static_cast<uint64_t>(id) : -static_cast<uint64_t>(id);
+}
+
+id_set::~id_set(){}
+
+void id_set::get_batch(const std::vector<osmium::object_id_type>& ids,
+                       std::vector<bool>& results) const{
+  results.resize(ids.size());
+  for(std::size_t i = 0; i < ids.size(); ++i){
+    results[i] = get(ids[i]);
+  }
+}
+
+const char* hash_id_set::name() const{
+  return "hash";
+}
+
+void hash_id_set::set(osmium::object_id_type id){
+  _ids.insert(id);
+}
+
+bool hash_id_set::get(osmium::object_id_type id) const{
+  return _ids.find(id) != _ids.end();
+}
+
+std::size_t hash_id_set::size() const{
+  return _ids.size();
+}
+
+std::size_t hash_id_set::memory() const{
+  // One allocated node per id with a next pointer, plus allocator
+  // overhead, and the bucket array.
+  return _ids.size() * (sizeof(osmium::object_id_type) + 3 * sizeof(void*))
+    + _ids.bucket_count() * sizeof(void*);
+}
+
+void hash_id_set::for_each(const std::function<void(osmium::object_id_type)>& f) const{
+  std::vector<osmium::object_id_type> ids(_ids.begin(), _ids.end());
+  std::sort(ids.begin(), ids.end());
+  for(auto id: ids){
+    f(id);
+  }
+}
+
+dense_id_set::dense_id_set():
+  _chunks(0),
+  _size(0){}
+
+const uint64_t* dense_id_set::word(osmium::object_id_type id) const{
+  const chunks_t& chunks = (id >= 0) ? _positive_chunks : _negative_chunks;
+  const uint64_t value = magnitude(id);
+  const std::size_t chunk = value >> dense_chunk_bits;
+  if((chunk >= chunks.size()) or !chunks[chunk]){
+    return nullptr;
+  }
+  return chunks[chunk].get() + ((value & dense_chunk_mask) >> 6);
+}
+
+const char* dense_id_set::name() const{
+  return "dense";
+}
+
+void dense_id_set::set(osmium::object_id_type id){
+  chunks_t& chunks = (id >= 0) ? _positive_chunks : _negative_chunks;
+  const uint64_t value = magnitude(id);
+  const std::size_t chunk = value >> dense_chunk_bits;
+  if(chunk >= chunks.size()){
+    chunks.resize(chunk + 1);
+  }
+  if(!chunks[chunk]){
+    chunks[chunk].reset(new uint64_t[dense_chunk_words]());
+    ++_chunks;
+  }
+  uint64_t& word = chunks[chunk][(value & dense_chunk_mask) >> 6];
+  const uint64_t mask = uint64_t(1) << (value & 63);
+  if(!(word & mask)){
+    word |= mask;
+    ++_size;
+  }
+}
+
+bool dense_id_set::get(osmium::object_id_type id) const{
+  const uint64_t* w = word(id);
+  return (w != nullptr) and ((*w >> (magnitude(id) & 63)) & 1);
+}
+
+void dense_id_set::get_batch(const std::vector<osmium::object_id_type>& ids,
+                             std::vector<bool>& results) const{
+  results.resize(ids.size());
+  for(std::size_t i = 0; i < ids.size(); ++i){
+    if(i + prefetch_distance < ids.size()){
+      const uint64_t* ahead = word(ids[i + prefetch_distance]);
+      if(ahead != nullptr){
+        __builtin_prefetch(ahead);
+      }
+    }
+    results[i] = get(ids[i]);
+  }
+}
+
+std::size_t dense_id_set::size() const{
+  return _size;
+}
+
+std::size_t dense_id_set::memory() const{
+  // Allocated chunks and pointer vectors spanning the highest ids.
+  return _chunks * dense_chunk_bytes
+    + (_positive_chunks.capacity() + _negative_chunks.capacity()) * sizeof(void*);
+}
+
+void dense_id_set::for_each(const std::function<void(osmium::object_id_type)>& f) const{
+  // Negative ids are stored by absolute value, so visited backwards.
+  for(std::size_t c = _negative_chunks.size(); c-- > 0;){
+    if(!_negative_chunks[c]){
+      continue;
+    }
+    const uint64_t first = static_cast<uint64_t>(c) << dense_chunk_bits;
+    for(std::size_t w = dense_chunk_words; w-- > 0;){
+      for(uint64_t word = _negative_chunks[c][w]; word != 0;){
+        const unsigned bit = 63 - __builtin_clzll(word);
+        word &= ~(uint64_t(1) << bit);
+        f(-static_cast<osmium::object_id_type>(first + 64 * w + bit));
+      }
+    }
+  }
+  for(std::size_t c = 0; c < _positive_chunks.size(); ++c){
+    if(!_positive_chunks[c]){
+      continue;
+    }
+    const uint64_t first = static_cast<uint64_t>(c) << dense_chunk_bits;
+    for(std::size_t w = 0; w < dense_chunk_words; ++w){
+      for(uint64_t word = _positive_chunks[c][w]; word != 0; word &= word - 1){
+        f(static_cast<osmium::object_id_type>(first + 64 * w + __builtin_ctzll(word)));
+      }
+    }
+  }
+}
+
+compressed_id_set::compressed_id_set():
+  _size(0),
+  _last(0){}
+
+bool compressed_id_set::contains(const container& c, uint16_t low){
+  switch(c.type){
+  case container_type::array:
+    return std::binary_search(c.values.begin(), c.values.end(), low);
+  case container_type::bitmap:
+    return (c.bits[low >> 6] >> (low & 63)) & 1;
+  case container_type::runs:
+    break;
+  }
+  // Last run starting at or before low.
+  std::size_t first = 0;
+  std::size_t last = c.values.size() / 2;
+  while(first < last){
+    const std::size_t middle = (first + last) / 2;
+    if(c.values[2 * middle] <= low){
+      first = middle + 1;
+    }
+    else{
+      last = middle;
+    }
+  }
+  return (first > 0) and (low <= c.values[2 * first - 1]);
+}
+
+void compressed_id_set::to_bitmap(container& c){
+  std::vector<uint64_t> bits(bitmap_words, 0);
+  auto set_bit = [&](uint32_t value){
+    bits[value >> 6] |= uint64_t(1) << (value & 63);
+  };
+  if(c.type == container_type::array){
+    for(auto value: c.values){
+      set_bit(value);
+    }
+  }
+  else{
+    for(std::size_t r = 0; r < c.values.size(); r += 2){
+      for(uint32_t value = c.values[r]; value <= c.values[r + 1]; ++value){
+        set_bit(value);
+      }
+    }
+  }
+  c.type = container_type::bitmap;
+  c.values = std::vector<uint16_t>();
+  c.bits = std::move(bits);
+}
+
+bool compressed_id_set::add(container& c, uint16_t low){
+  if(c.type == container_type::runs){
+    if(contains(c, low)){
+      return false;
+    }
+    // Runs are only built once a set is filled.
+    to_bitmap(c);
+  }
+  if(c.type == container_type::array){
+    const auto position = std::lower_bound(c.values.begin(), c.values.end(), low);
+    if((position != c.values.end()) and (*position == low)){
+      return false;
+    }
+    if(c.values.size() < max_array_size){
+      c.values.insert(position, low);
+      ++c.cardinality;
+      return true;
+    }
+    to_bitmap(c);
+  }
+  uint64_t& word = c.bits[low >> 6];
+  const uint64_t mask = uint64_t(1) << (low & 63);
+  if(word & mask){
+    return false;
+  }
+  word |= mask;
+  ++c.cardinality;
+  return true;
+}
+
+const char* compressed_id_set::name() const{
+  return "compressed";
+}
+
+void compressed_id_set::set(osmium::object_id_type id){
+  const uint64_t value = unsigned_id(id);
+  const uint64_t key = value >> 16;
+  if((_last >= _keys.size()) or (_keys[_last] != key)){
+    const auto position = std::lower_bound(_keys.begin(), _keys.end(), key);
+    _last = position - _keys.begin();
+    if((position == _keys.end()) or (*position != key)){
+      _keys.insert(position, key);
+      _containers.insert(_containers.begin() + _last,
+                         container{container_type::array, 0, {}, {}});
+    }
+  }
+  if(add(_containers[_last], static_cast<uint16_t>(value & 0xFFFF))){
+    ++_size;
+  }
+}
+
+std::size_t compressed_id_set::find(uint64_t value) const{
+  const auto position = std::lower_bound(_keys.begin(), _keys.end(), value >> 16);
+  if((position == _keys.end()) or (*position != (value >> 16))){
+    return _keys.size();
+  }
+  return position - _keys.begin();
+}
+
+bool compressed_id_set::get(osmium::object_id_type id) const{
+  const uint64_t value = unsigned_id(id);
+  const std::size_t rank = find(value);
+  return (rank < _keys.size())
+    and contains(_containers[rank], static_cast<uint16_t>(value & 0xFFFF));
+}
+
+void compressed_id_set::get_batch(const std::vector<osmium::object_id_type>& ids,
+                                  std::vector<bool>& results) const{
+  results.resize(ids.size());
+
+  // Containers found for the next ids, their content being
+  // prefetched meanwhile.
+  std::size_t ranks[prefetch_distance];
+  auto prefetch = [&](std::size_t i){
+    const uint64_t value = unsigned_id(ids[i]);
+    const std::size_t rank = find(value);
+    ranks[i % prefetch_distance] = rank;
+    if(rank == _keys.size()){
+      return;
+    }
+    const container& c = _containers[rank];
+    if(c.type == container_type::bitmap){
+      __builtin_prefetch(c.bits.data() + ((value & 0xFFFF) >> 6));
+    }
+    else if(!c.values.empty()){
+      // First probe of the binary search.
+      __builtin_prefetch(c.values.data() + c.values.size() / 2);
+    }
+  };
+
+  for(std::size_t i = 0; (i < prefetch_distance) and (i < ids.size()); ++i){
+    prefetch(i);
+  }
+  for(std::size_t i = 0; i < ids.size(); ++i){
+    const std::size_t rank = ranks[i % prefetch_distance];
+    if(i + prefetch_distance < ids.size()){
+      prefetch(i + prefetch_distance);
+    }
+    results[i] = (rank < _keys.size())
+      and contains(_containers[rank],
+                   static_cast<uint16_t>(unsigned_id(ids[i]) & 0xFFFF));
+  }
+}
+
+std::size_t compressed_id_set::size() const{
+  return _size;
+}
+
+std::size_t compressed_id_set::memory() const{
+  std::size_t bytes = _keys.capacity() * sizeof(uint64_t)
+    + _containers.capacity() * sizeof(container);
+  for(const auto& c: _containers){
+    bytes += c.values.capacity() * sizeof(uint16_t)
+      + c.bits.capacity() * sizeof(uint64_t);
+  }
+  return bytes;
+}
+
+void compressed_id_set::for_each(const std::function<void(osmium::object_id_type)>& f) const{
+  for(std::size_t i = 0; i < _keys.size(); ++i){
+    const uint64_t high = _keys[i] << 16;
+    const container& c = _containers[i];
+    switch(c.type){
+    case container_type::array:
+      for(auto value: c.values){
+        f(signed_id(high | value));
+      }
+      break;
+    case container_type::bitmap:
+      for(std::size_t w = 0; w < bitmap_words; ++w){
+        for(uint64_t word = c.bits[w]; word != 0; word &= word - 1){
+          f(signed_id(high | (64 * w + __builtin_ctzll(word))));
+        }
+      }
+      break;
+    case container_type::runs:
+      for(std::size_t r = 0; r < c.values.size(); r += 2){
+        for(uint32_t value = c.values[r]; value <= c.values[r + 1]; ++value){
+          f(signed_id(high | value));
+        }
+      }
+      break;
+    }
+  }
+}
+
+void compressed_id_set::optimize(){
+  for(auto& c: _containers){
+    std::vector<uint16_t> runs;
+    auto add_value = [&](uint16_t value){
+      if(!runs.empty() and (runs.back() + 1 == value)){
+        runs.back() = value;
+      }
+      else{
+        runs.push_back(value);
+        runs.push_back(value);
+      }
+    };
+    switch(c.type){
+    case container_type::array:
+      for(auto value: c.values){
+        add_value(value);
+      }
+      break;
+    case container_type::bitmap:
+      for(std::size_t w = 0; w < bitmap_words; ++w){
+        for(uint64_t word = c.bits[w]; word != 0; word &= word - 1){
+          add_value(static_cast<uint16_t>(64 * w + __builtin_ctzll(word)));
+        }
+      }
+      break;
+    case container_type::runs:
+      continue;
+    }
+
+    const std::size_t runs_bytes = runs.size() * sizeof(uint16_t);
+    const std::size_t array_bytes = c.cardinality * sizeof(uint16_t);
+    const std::size_t bitmap_bytes = bitmap_words * sizeof(uint64_t);
+    if((runs_bytes < array_bytes) and (runs_bytes < bitmap_bytes)){
+      c.type = container_type::runs;
+      c.values = std::move(runs);
+      c.bits = std::vector<uint64_t>();
+    }
+    else if(c.type == container_type::array){
+      c.values.shrink_to_fit();
+    }
+  }
+  _keys.shrink_to_fit();
+  _containers.shrink_to_fit();
+}
+
+std::size_t compressed_id_set::dense_memory() const{
+  // A dense chunk spans 2^(dense_chunk_bits - 16) containers.
+  std::size_t chunks = 0;
+  uint64_t previous_chunk = std::numeric_limits<uint64_t>::max();
+  for(auto key: _keys){
+    const uint64_t chunk = key >> (dense_chunk_bits - 16);
+    if(chunk != previous_chunk){
+      ++chunks;
+      previous_chunk = chunk;
+    }
+  }
+  std::size_t pointers = 0;
+  if(!_keys.empty()){
+    const osmium::object_id_type highest = signed_id((_keys.back() << 16) | 0xFFFF);
+    const osmium::object_id_type lowest = signed_id(_keys.front() << 16);
+    pointers = (std::max<osmium::object_id_type>(highest, 0) >> dense_chunk_bits)
+      + (std::max<osmium::object_id_type>(-lowest, 0) >> dense_chunk_bits) + 2;
+  }
+  return chunks * dense_chunk_bytes + pointers * sizeof(void*);
+}
+
+sorted_ids::sorted_ids(const std::vector<const id_set*>& sets){
+  std::size_t size = 0;
+  for(auto set: sets){
+    size += set->size();
+  }
+  _ids.reserve(size);
+  for(auto set: sets){
+    const auto middle = _ids.size();
+    set->for_each([&](osmium::object_id_type id){
+        _ids.push_back(id);
+      });
+    std::inplace_merge(_ids.begin(), _ids.begin() + middle, _ids.end());
+  }
+  _ids.erase(std::unique(_ids.begin(), _ids.end()), _ids.end());
+}
+
+bool sorted_ids::get(osmium::object_id_type id, std::size_t& position) const{
+  // Gallop from the cursor to bound the search across large gaps
+  // between queried ids.
+  std::size_t low = position;
+  std::size_t step = 1;
+  while((low + step < _ids.size()) and (_ids[low + step] < id)){
+    low += step;
+    step *= 2;
+  }
+  const auto last = _ids.begin() + std::min(low + step, _ids.size());
+  position = std::lower_bound(_ids.begin() + low, last, id) - _ids.begin();
+  return (position < _ids.size()) and (_ids[position] == id);
+}
+
+std::size_t sorted_ids::size() const{
+  return _ids.size();
+}
+
+std::size_t sorted_ids::memory() const{
+  return _ids.capacity() * sizeof(osmium::object_id_type);
+}
+
+const std::vector<std::string>& id_set_names(){
+  static const std::vector<std::string> names({"auto",
+                                               "dense",
+                                               "compressed",
+                                               "hash"});
+  return names;
+}
+
+std::unique_ptr<id_set> make_id_set(const std::string& name){
+  if(name == "dense"){
+    return std::make_unique<dense_id_set>();
+  }
+  if(name == "hash"){
+    return std::make_unique<hash_id_set>();
+  }
+  if((name == "compressed") or (name == "auto")){
+    return std::make_unique<compressed_id_set>();
+  }
+  return nullptr;
+}
+
+std::unique_ptr<id_set> select_id_set(const std::string& name,
+                                      std::unique_ptr<id_set> set){
+  auto compressed = dynamic_cast<compressed_id_set*>(set.get());
+  if(compressed == nullptr){
+    return set;
+  }
+  compressed->optimize();
+  if((name != "auto")
+     or (compressed->dense_memory() > dense_memory_factor * compressed->memory())){
+    return set;
+  }
+  // Ids are dense enough for constant-time lookups to be worth the
+  // extra memory.
+  std::unique_ptr<id_set> dense = std::make_unique<dense_id_set>();
+  set->for_each([&](osmium::object_id_type id){
+      dense->set(id);
+    });
+  return dense;
+}
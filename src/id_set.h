@@ -0,0 +1,196 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <osmium/osm/types.hpp>
+
+// Set of object ids kept between passes. Available implementations
+// are a hash set, dense bitsets using one bit per possible id in
+// chunks allocated on demand, and compressed bitsets adapting to the
+// id density.
+class id_set{
+public:
+  virtual ~id_set();
+
+  virtual const char* name() const = 0;
+
+  virtual void set(osmium::object_id_type id) = 0;
+
+  virtual bool get(osmium::object_id_type id) const = 0;
+
+  // Set results[i] to get(ids[i]) for all ids, implementations
+  // overlapping memory accesses for successive ids.
+  virtual void get_batch(const std::vector<osmium::object_id_type>& ids,
+                         std::vector<bool>& results) const;
+
+  // Number of ids in the set.
+  virtual std::size_t size() const = 0;
+
+  // Approximate heap memory used, in bytes.
+  virtual std::size_t memory() const = 0;
+
+  // Call f for all ids in ascending order.
+  virtual void for_each(const std::function<void(osmium::object_id_type)>& f) const = 0;
+};
+
+class hash_id_set : public id_set{
+private:
+  std::unordered_set<osmium::object_id_type> _ids;
+
+public:
+  const char* name() const override;
+
+  void set(osmium::object_id_type id) override;
+
+  bool get(osmium::object_id_type id) const override;
+
+  std::size_t size() const override;
+
+  std::size_t memory() const override;
+
+  void for_each(const std::function<void(osmium::object_id_type)>& f) const override;
+};
+
+// Bitsets using one bit per possible id, in chunks allocated on
+// demand. Negative ids, e.g. from editors, go to a second bitset.
+class dense_id_set : public id_set{
+private:
+  typedef std::vector<std::unique_ptr<uint64_t[]>> chunks_t;
+
+  chunks_t _positive_chunks;
+  chunks_t _negative_chunks;
+  std::size_t _chunks;
+  std::size_t _size;
+
+  // Word holding the bit for id, nullptr if its chunk is not
+  // allocated.
+  const uint64_t* word(osmium::object_id_type id) const;
+
+public:
+  dense_id_set();
+
+  const char* name() const override;
+
+  void set(osmium::object_id_type id) override;
+
+  bool get(osmium::object_id_type id) const override;
+
+  void get_batch(const std::vector<osmium::object_id_type>& ids,
+                 std::vector<bool>& results) const override;
+
+  std::size_t size() const override;
+
+  std::size_t memory() const override;
+
+  void for_each(const std::function<void(osmium::object_id_type)>& f) const override;
+};
+
+// Roaring-style bitmap: ids are split in chunks of 64K values, each
+// chunk stored as a sorted array of its low 16 bits, a bitmap or a
+// list of runs, whichever is the smallest.
+class compressed_id_set : public id_set{
+private:
+  enum class container_type : uint8_t{array, bitmap, runs};
+
+  // Values holds sorted low bits for arrays, first and last values
+  // of each run for runs.
+  struct container{
+    container_type type;
+    uint32_t cardinality;
+    std::vector<uint16_t> values;
+    std::vector<uint64_t> bits;
+  };
+
+  // Containers sorted by chunk key.
+  std::vector<uint64_t> _keys;
+  std::vector<container> _containers;
+  std::size_t _size;
+
+  // Container where the last id was set, ids being mostly set in
+  // ascending order.
+  std::size_t _last;
+
+  // Rank of the container for id, _keys.size() if there is none.
+  std::size_t find(uint64_t value) const;
+
+  static bool contains(const container& c, uint16_t low);
+
+  // Return false if low was already in c.
+  static bool add(container& c, uint16_t low);
+
+  static void to_bitmap(container& c);
+
+public:
+  compressed_id_set();
+
+  const char* name() const override;
+
+  void set(osmium::object_id_type id) override;
+
+  bool get(osmium::object_id_type id) const override;
+
+  void get_batch(const std::vector<osmium::object_id_type>& ids,
+                 std::vector<bool>& results) const override;
+
+  std::size_t size() const override;
+
+  std::size_t memory() const override;
+
+  void for_each(const std::function<void(osmium::object_id_type)>& f) const override;
+
+  // Store each container in its smallest form, using runs where
+  // relevant.
+  void optimize();
+
+  // Approximate memory used by the same ids in a dense_id_set.
+  std::size_t dense_memory() const;
+};
+
+// Sorted ids from one or more sets, for inputs where objects come in
+// ascending id order. Lookups move a cursor forward instead of
+// accessing sets at random.
+class sorted_ids{
+private:
+  std::vector<osmium::object_id_type> _ids;
+
+public:
+  sorted_ids(const std::vector<const id_set*>& sets);
+
+  // Whether id is in the sets, ids being queried in ascending order
+  // with the same cursor position, starting from 0.
+  bool get(osmium::object_id_type id, std::size_t& position) const;
+
+  std::size_t size() const;
+
+  std::size_t memory() const;
+};
+
+// Names accepted by make_id_set.
+const std::vector<std::string>& id_set_names();
+
+// Build an empty set with given implementation name, return nullptr
+// for an unknown name. Sets built with the "auto" name start as
+// compressed sets.
+std::unique_ptr<id_set> make_id_set(const std::string& name);
+
+// Once a set built with make_id_set(name) is filled and name is
+// "auto", switch to dense bitsets if ids are dense enough for them to
+// use little more memory. Compressed sets are optimized.
+std::unique_ptr<id_set> select_id_set(const std::string& name,
+                                      std::unique_ptr<id_set> set);
+
+#endif
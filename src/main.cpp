@@ -7,18 +7,38 @@ All rights reserved (see LICENSE).
 
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
 #include <iostream>
-#include <fstream>
-#include "polygon.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include "geojson.h"
+#include "id_set.h"
+#include "polygon_index.h"
+#include "polygon_set.h"
 #include "osm_parser.h"
-#include "../include/rapidjson/document.h"
-#include "../include/rapidjson/error/en.h"
 
 void display_usage(){
-  std::string usage = "Usage : osmium-polygon -p GEOJSON_FILE [-o=OUT] OSM_FILE\n";
+  std::string usage = "Usage : osmium-polygon -p GEOJSON_FILE [-o=OUT] [--index=INDEX] [--id-set=TYPE] [--sorted] [--extracts] [--memory-budget=MB] [-j N] [-v] OSM_FILE\n";
   usage += "Crop OSM data in FILE using (multi)-polygons in GEOJSON_FILE and write it to OUT.\n";
   usage += "\t-p GEOJSON_FILE\t geojson file containing the polygon\n";
   usage += "\t-o OUTPUT\t output file name\n";
+  usage += "\t-i, --index=INDEX\t spatial index used to locate nodes: rtree (default),\n";
+  usage += "\t\t\t grid, quadtree or packed\n";
+  usage += "\t-c\t\t same as --index=quadtree\n";
+  usage += "\t--id-set=TYPE\t storage for object ids between passes: auto (default),\n";
+  usage += "\t\t\t dense, compressed or hash\n";
+  usage += "\t--sorted\t filter objects against sorted id vectors for input\n";
+  usage += "\t\t\t sorted by id, falling back to id sets otherwise\n";
+  usage += "\t--extracts\t write one extract per \"output\" property value of\n";
+  usage += "\t\t\t polygon features to the file it names, ignoring -o\n";
+  usage += "\t--memory-budget=MB\t keep up to MB megabytes of input in memory\n";
+  usage += "\t\t\t between passes instead of reading it again\n";
+  usage += "\t-j N\t\t check nodes and filter objects using N threads (default: 1)\n";
+  usage += "\t-v\t\t verbose output\n";
   std::cout << usage;
   exit(0);
 }
@@ -28,25 +48,80 @@ int main(int argc, char* argv[]){
   std::string input_name;
   std::string output_name;
   std::string poly_name;
+  std::string index_name = "rtree";
+  std::string id_set_name = "auto";
+  bool sorted_lookups = false;
+  bool several_extracts = false;
+  unsigned threads = 1;
+  std::size_t memory_budget = 0;
+  bool verbose = false;
 
   // Parsing command-line options
-  const char* optString = "o:p:h?";
-
-  int opt = getopt(argc, argv, optString);
+  const char* optString = "ci:j:o:p:vh?";
+  const option long_options[] = {
+    {"index", required_argument, nullptr, 'i'},
+    {"id-set", required_argument, nullptr, 's'},
+    {"sorted", no_argument, nullptr, 'S'},
+    {"extracts", no_argument, nullptr, 'x'},
+    {"memory-budget", required_argument, nullptr, 'm'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}
+  };
+
+  int opt = getopt_long(argc, argv, optString, long_options, nullptr);
 
   while(opt != -1){
     switch(opt){
+    case 'c':
+      index_name = "quadtree";
+      break;
+    case 'i':
+      index_name = optarg;
+      break;
+    case 's':
+      id_set_name = optarg;
+      break;
+    case 'S':
+      sorted_lookups = true;
+      break;
+    case 'x':
+      several_extracts = true;
+      break;
+    case 'm':
+      memory_budget = static_cast<std::size_t>(std::max(std::atoi(optarg), 0)) * 1024 * 1024;
+      break;
+    case 'j':
+      threads = std::max(std::atoi(optarg), 1);
+      break;
     case 'o':
       output_name = optarg;
       break;
     case 'p':
       poly_name = optarg;
       break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+    case '?':
+      display_usage();
+      break;
     default:
       // Shouldn't be used.
       break;
     }
-    opt = getopt(argc, argv, optString);
+    opt = getopt_long(argc, argv, optString, long_options, nullptr);
+  }
+
+  if(threads > 1){
+    // Node checks share the osmium thread pool with input decoding,
+    // size it unless set by the user.
+    setenv("OSMIUM_POOL_THREADS", std::to_string(threads).c_str(), 0);
+  }
+
+  if(!make_id_set(id_set_name)){
+    std::cout << "[error] Unknown id set: " << id_set_name << ".\n";
+    exit(1);
   }
 
   // Getting input file from command-line.
@@ -67,97 +142,78 @@ int main(int argc, char* argv[]){
   }
   std::cout << "[info] Parsing geojson file, searching for polygons...\n";
 
-  rapidjson::Document json_input;
+  // One polygon set per output file.
+  std::vector<std::string> outputs;
+  std::vector<std::unique_ptr<polygon_set>> polygon_sets;
   std::string error_msg;
-
-  std::ifstream ifs (poly_name);
-  std::stringstream buffer;
-  buffer << ifs.rdbuf();
-
-  if(json_input.Parse(buffer.str().c_str()).HasParseError()){
-      std::string error_msg = std::string(rapidjson::GetParseError_En(json_input.GetParseError()))
-        + " (offset: "
-        + std::to_string(json_input.GetErrorOffset())
-        + ")";
-      std::cout << error_msg << std::endl;
-      exit(1);
+  bool parsed;
+  if(several_extracts){
+    parsed = read_extracts(poly_name, outputs, polygon_sets, error_msg);
   }
-
-  if(!json_input.HasMember("features")
-     or !json_input["features"].IsArray()){
-    std::cout << "[error] Invalid \"features\" key.\n";
-    exit(1);
+  else{
+    outputs.push_back(output_name);
+    polygon_sets.emplace_back(new polygon_set());
+    parsed = read_polygons(poly_name, *polygon_sets.front(), error_msg);
   }
-
-  std::vector<std::string> name_keys({"name", "id", "ID"});
-
-  std::vector<polygon> polygons;
-
-  // Finding the first polygon feature in the json file.
-  for(rapidjson::SizeType i = 0; i < json_input["features"].Size(); ++i){
-    auto& feature = json_input["features"][i];
-    if(!feature.HasMember("geometry")
-       or !feature["geometry"].HasMember("type")
-       or !feature["geometry"]["type"].IsString()
-       or (feature["geometry"]["type"] != "Polygon"
-           and feature["geometry"]["type"] != "MultiPolygon")
-       or !feature["geometry"].HasMember("coordinates")
-       or !feature["geometry"]["coordinates"].IsArray()){
-      continue;
-    }
-    std::string current_name;
-    if(feature.HasMember("properties")){
-      for(const auto& name: name_keys){
-        if(feature["properties"].HasMember(name.c_str())
-           and feature["properties"][name.c_str()].IsString()){
-          // Using property name.
-          current_name = feature["properties"][name.c_str()].GetString();
-          break;
-        }
-      }
-    }
-    if(current_name.empty()){
-      // Default to feature index.
-      current_name = "feature_" + std::to_string(i);
-      }
-
-    if(feature["geometry"]["type"] == "Polygon"){
-      polygons.emplace_back(current_name,
-                            feature["geometry"]["coordinates"]);
-    }
-    if(feature["geometry"]["type"] == "MultiPolygon"){
-      auto& coordinates = feature["geometry"]["coordinates"];
-      for(rapidjson::SizeType i = 0; i < coordinates.Size(); ++i){
-        polygons.emplace_back(current_name + "_" + std::to_string(i),
-                              coordinates[i]);
-      }
-    }
+  if(!parsed){
+    std::cout << error_msg << std::endl;
+    exit(1);
   }
 
-  if(polygons.empty()){
+  if(polygon_sets.empty() or polygon_sets.front()->empty()){
     std::cout << "[info] No polygon feature found in file: "
               << poly_name << "!\n";
     return 0;
   }
-  else{
+
+  std::vector<std::unique_ptr<polygon_index>> indexes;
+  std::vector<extract> extracts;
+  for(std::size_t e = 0; e < outputs.size(); ++e){
+    const polygon_set& polygons = *polygon_sets[e];
     std::cout << "[info] Found "
               << polygons.size()
-              << " polygon feature(s).\n";
-
-    std::cout << "[info] Building R-tree...\n";
-
-    rtree_t rtree;
-    for(unsigned i = 0 ; i < polygons.size() ; ++i){
-      const osmium::Box osmium_box = polygons[i].bbox();
-      const auto bl = osmium_box.bottom_left();
-      const auto tr = osmium_box.top_right();
+              << " polygon feature(s)";
+    if(several_extracts){
+      std::cout << " for " << outputs[e];
+    }
+    std::cout << ".\n";
+
+    if(verbose){
+      // Report which inclusion check is used for each ring.
+      for(std::size_t p = 0; p < polygons.size(); ++p){
+        std::cout << "* " << polygons.name(p) << ": "
+                  << shape_name(polygons.shape(p, 0)) << " outer ring";
+        for(std::size_t r = 1; r < polygons.rings_number(p); ++r){
+          std::cout << ((r == 1) ? ", inner rings: " : ", ")
+                    << shape_name(polygons.shape(p, r));
+        }
+        std::cout << ".\n";
+      }
+    }
 
-      box b(point(bl.lon(), bl.lat()), point(tr.lon(), tr.lat()));
+    std::cout << "[info] Building " << index_name << " index...\n";
 
-      rtree.insert(std::make_pair(b, i));
+    const auto build_start = std::chrono::steady_clock::now();
+    auto index = make_index(index_name, polygons);
+    if(!index){
+      std::cout << "[error] Unknown index: " << index_name << ".\n";
+      exit(1);
     }
-
-    return parse_file(input_name, output_name, polygons, rtree);
+    const auto build_end = std::chrono::steady_clock::now();
+    std::cout << "* "
+              << index->description()
+              << ", built in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(build_end - build_start).count()
+              << "ms.\n";
+
+    extracts.push_back(extract{outputs[e], polygons, *index});
+    indexes.push_back(std::move(index));
   }
-}
 
+  return parse_file(input_name,
+                    extracts,
+                    id_set_name,
+                    sorted_lookups,
+                    threads,
+                    memory_budget);
+}
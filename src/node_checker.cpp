@@ -0,0 +1,208 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <limits>
+#include <osmium/osm/node.hpp>
+#include <osmium/thread/pool.hpp>
+#include "cell_covering.h"
+#include "node_checker.h"
+
+// Level of the cells cached while checking nodes, about 500m wide.
+constexpr unsigned cache_level = 16;
+constexpr unsigned cache_shift = 2 * (32 - cache_level);
+
+node_checker::stats::stats():
+  nodes(0),
+  cache_hits(0),
+  cache_misses(0),
+  cache_answers(0){}
+
+node_checker::stats& node_checker::stats::operator+=(const stats& other){
+  nodes += other.nodes;
+  cache_hits += other.cache_hits;
+  cache_misses += other.cache_misses;
+  cache_answers += other.cache_answers;
+  return *this;
+}
+
+node_checker::node_checker(const polygon_set& polygons,
+                           const polygon_index& index):
+  _polygons(polygons),
+  _index(index),
+  _cached_cell(std::numeric_limits<uint64_t>::max()),
+  _cached_position(box_position::outside){}
+
+void node_checker::cache_cell(const osmium::Location& loc){
+  _cached_cell = cell_covering::key(loc) >> cache_shift;
+  _cached_position = _index.classify(cell_covering::cell_box(loc, cache_level),
+                                     _cached_ranks);
+}
+
+void node_checker::check(const osmium::memory::Buffer& buffer,
+                         std::vector<osmium::object_id_type>& inside_ids){
+  _batch_ids.clear();
+  _batch_locations.clear();
+  for(const auto& node: buffer.select<osmium::Node>()){
+    _batch_ids.push_back(node.id());
+    _batch_locations.push_back(node.location());
+  }
+  check(_batch_ids, _batch_locations, inside_ids);
+}
+
+void node_checker::check(const node_locations& nodes,
+                         std::vector<osmium::object_id_type>& inside_ids){
+  check(nodes.ids, nodes.locations, inside_ids);
+}
+
+void node_checker::check(const std::vector<osmium::object_id_type>& ids,
+                         const std::vector<osmium::Location>& locations,
+                         std::vector<osmium::object_id_type>& inside_ids){
+  _stats.nodes += ids.size();
+
+  _batch_inside.assign(locations.size(), false);
+  _candidates.clear();
+  for(uint32_t i = 0; i < locations.size(); ++i){
+    const auto& loc = locations[i];
+    if((cell_covering::key(loc) >> cache_shift) == _cached_cell){
+      ++_stats.cache_hits;
+    }
+    else{
+      ++_stats.cache_misses;
+      cache_cell(loc);
+    }
+
+    switch(_cached_position){
+    case box_position::inside:
+      _batch_inside[i] = true;
+      ++_stats.cache_answers;
+      break;
+    case box_position::outside:
+      ++_stats.cache_answers;
+      break;
+    case box_position::boundary:
+      if(_index.checks_locations()){
+        _batch_inside[i] = _index.contains(loc, _cached_ranks);
+      }
+      else{
+        for(auto rank: _cached_ranks){
+          _candidates.emplace_back(rank, i);
+        }
+      }
+      break;
+    }
+  }
+  std::sort(_candidates.begin(), _candidates.end());
+
+  auto candidate = _candidates.cbegin();
+  while(candidate != _candidates.cend()){
+    const auto polygon_rank = candidate->first;
+    _polygon_indices.clear();
+    _polygon_locations.clear();
+    for(; (candidate != _candidates.cend())
+          and (candidate->first == polygon_rank); ++candidate){
+      if(!_batch_inside[candidate->second]){
+        // No need to check again nodes found in a previous polygon.
+        _polygon_indices.push_back(candidate->second);
+        _polygon_locations.push_back(locations[candidate->second]);
+      }
+    }
+
+    _polygon_contained.assign(_polygon_locations.size(), false);
+    _polygons.contains_batch(polygon_rank,
+                             _polygon_locations,
+                             _polygon_contained);
+    for(std::size_t j = 0; j < _polygon_indices.size(); ++j){
+      if(_polygon_contained[j]){
+        _batch_inside[_polygon_indices[j]] = true;
+      }
+    }
+  }
+
+  for(std::size_t i = 0; i < ids.size(); ++i){
+    if(_batch_inside[i]){
+      inside_ids.push_back(ids[i]);
+    }
+  }
+}
+
+const node_checker::stats& node_checker::statistics() const{
+  return _stats;
+}
+
+parallel_node_checker::parallel_node_checker(const polygon_set& polygons,
+                                             const polygon_index& index,
+                                             id_set& inside_nodes,
+                                             unsigned threads):
+  _polygons(polygons),
+  _index(index),
+  _inside_nodes(inside_nodes),
+  _threads(std::max(threads, 1u)),
+  _checker(polygons, index){}
+
+parallel_node_checker::~parallel_node_checker(){
+  // Pending tasks use the polygons and index.
+  for(auto& pending: _pending){
+    pending.wait();
+  }
+}
+
+void parallel_node_checker::store_first(){
+  const auto first = _pending.front().get();
+  _pending.pop_front();
+  for(auto id: first.inside_ids){
+    _inside_nodes.set(id);
+  }
+  _stats += first.stats;
+}
+
+template<class Nodes>
+void parallel_node_checker::submit(const std::shared_ptr<const Nodes>& nodes){
+  if(_threads == 1){
+    _inside_ids.clear();
+    _checker.check(*nodes, _inside_ids);
+    for(auto id: _inside_ids){
+      _inside_nodes.set(id);
+    }
+    _stats = _checker.statistics();
+    return;
+  }
+
+  if(_pending.size() >= 2 * _threads){
+    store_first();
+  }
+  const polygon_set& polygons = _polygons;
+  const polygon_index& index = _index;
+  _pending.push_back(osmium::thread::Pool::instance().submit([&polygons, &index, nodes]{
+        // Each buffer gets its own cache and scratch space.
+        node_checker checker(polygons, index);
+        result r;
+        checker.check(*nodes, r.inside_ids);
+        r.stats = checker.statistics();
+        return r;
+      }));
+}
+
+void parallel_node_checker::check(const std::shared_ptr<const osmium::memory::Buffer>& buffer){
+  submit(buffer);
+}
+
+void parallel_node_checker::check(const std::shared_ptr<const node_locations>& nodes){
+  submit(nodes);
+}
+
+void parallel_node_checker::wait(){
+  while(!_pending.empty()){
+    store_first();
+  }
+}
+
+const node_checker::stats& parallel_node_checker::statistics() const{
+  return _stats;
+}
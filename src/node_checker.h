@@ -0,0 +1,137 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef NODE_CHECKER_H
+#define NODE_CHECKER_H
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+#include "id_set.h"
+#include "polygon_index.h"
+#include "polygon_set.h"
+
+// Ids and locations of nodes, as decoded without building node
+// objects.
+struct node_locations{
+  std::vector<osmium::object_id_type> ids;
+  std::vector<osmium::Location> locations;
+};
+
+// Inclusion check for all nodes in a buffer at once. Candidate
+// polygons are first collected for every node, then each polygon
+// checks all its candidate locations in a row.
+class node_checker{
+public:
+  struct stats{
+    uint64_t nodes;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    // Nodes located from the cached cell classification only.
+    uint64_t cache_answers;
+
+    stats();
+
+    stats& operator+=(const stats& other);
+  };
+
+private:
+  const polygon_set& _polygons;
+  const polygon_index& _index;
+
+  // Scratch space reused for all node buffers.
+  std::vector<osmium::object_id_type> _batch_ids;
+  std::vector<osmium::Location> _batch_locations;
+  std::vector<bool> _batch_inside;
+  std::vector<std::pair<uint32_t, uint32_t>> _candidates;
+  std::vector<osmium::Location> _polygon_locations;
+  std::vector<uint32_t> _polygon_indices;
+  std::vector<bool> _polygon_contained;
+
+  // Classification of the last cell where a node was checked, with
+  // polygons to check if the cell is on a boundary.
+  uint64_t _cached_cell;
+  box_position _cached_position;
+  std::vector<uint32_t> _cached_ranks;
+
+  stats _stats;
+
+  void cache_cell(const osmium::Location& loc);
+
+  void check(const std::vector<osmium::object_id_type>& ids,
+             const std::vector<osmium::Location>& locations,
+             std::vector<osmium::object_id_type>& inside_ids);
+
+public:
+  node_checker(const polygon_set& polygons, const polygon_index& index);
+
+  // Append to inside_ids the ids of nodes in buffer that lie in one
+  // of the polygons, in buffer order.
+  void check(const osmium::memory::Buffer& buffer,
+             std::vector<osmium::object_id_type>& inside_ids);
+
+  // Same for nodes decoded as ids and locations.
+  void check(const node_locations& nodes,
+             std::vector<osmium::object_id_type>& inside_ids);
+
+  const stats& statistics() const;
+};
+
+// Node checks spread over the osmium thread pool, with up to twice
+// as many buffers in flight as threads. Inside node ids are stored in
+// input order, from the calling thread only. Buffers are checked in
+// the calling thread if there is a single thread.
+class parallel_node_checker{
+private:
+  struct result{
+    std::vector<osmium::object_id_type> inside_ids;
+    node_checker::stats stats;
+  };
+
+  const polygon_set& _polygons;
+  const polygon_index& _index;
+  id_set& _inside_nodes;
+  const unsigned _threads;
+
+  node_checker _checker;
+  std::vector<osmium::object_id_type> _inside_ids;
+  std::deque<std::future<result>> _pending;
+  node_checker::stats _stats;
+
+  // Store results for the oldest buffer in flight.
+  void store_first();
+
+  template<class Nodes>
+  void submit(const std::shared_ptr<const Nodes>& nodes);
+
+public:
+  parallel_node_checker(const polygon_set& polygons,
+                        const polygon_index& index,
+                        id_set& inside_nodes,
+                        unsigned threads);
+
+  ~parallel_node_checker();
+
+  void check(const std::shared_ptr<const osmium::memory::Buffer>& buffer);
+
+  void check(const std::shared_ptr<const node_locations>& nodes);
+
+  // Wait for all buffers in flight and store their results.
+  void wait();
+
+  // Statistics for buffers whose results are stored.
+  const node_checker::stats& statistics() const;
+};
+
+#endif
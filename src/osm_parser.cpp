@@ -9,230 +9,830 @@ All rights reserved (see LICENSE).
 
 #include "osm_parser.h"
 
+// Ways and relations handling for the first pass, once inside nodes
+// are known.
 struct polygon_check_handler : public osmium::handler::Handler{
-  uint64_t _all_nodes;
   uint32_t _all_ways;
   uint32_t _all_relations;
-  const std::vector<polygon>& _polygons;
-  const rtree_t& _rtree;
-  std::unordered_set<osmium::object_id_type>& _inside_nodes;
-  std::unordered_set<osmium::object_id_type>& _outside_nodes;
-  std::unordered_set<osmium::object_id_type>& _inside_ways;
-  std::unordered_set<osmium::object_id_type>& _inside_relations;
-
-  polygon_check_handler(const std::vector<polygon>& polygons,
-                        const rtree_t& rtree,
-                        std::unordered_set<osmium::object_id_type>& inside_nodes,
-                        std::unordered_set<osmium::object_id_type>& outside_nodes,
-                        std::unordered_set<osmium::object_id_type>& inside_ways,
-                        std::unordered_set<osmium::object_id_type>& inside_relations):
-    _all_nodes(0),
+  const id_set& _inside_nodes;
+  id_set& _outside_nodes;
+  id_set& _inside_ways;
+  id_set& _inside_relations;
+
+  polygon_check_handler(const id_set& inside_nodes,
+                        id_set& outside_nodes,
+                        id_set& inside_ways,
+                        id_set& inside_relations):
     _all_ways(0),
     _all_relations(0),
-    _polygons(polygons),
-    _rtree(rtree),
     _inside_nodes(inside_nodes),
     _outside_nodes(outside_nodes),
     _inside_ways(inside_ways),
-    _inside_relations(inside_relations){}
-
-  void node(osmium::Node& node){
-    ++_all_nodes;
-    // Query Rtree to limit checking to a few polygons.
-    std::vector<value> query_result;
-    _rtree.query(bgi::contains(point(node.location().lon(),
-                                     node.location().lat())),
-                 std::back_inserter(query_result));
-
-    auto container = std::find_if(query_result.begin(),
-                                  query_result.end(),
-                                  [&](const auto& v){
-                                    return _polygons[v.second].contains(node);
-                                  });
-
-    if(container != query_result.end()){
-      // One of the polygons contains this node. Remember node id for
-      // further checking of the ways.
-      _inside_nodes.insert(node.id());
+    _inside_relations(inside_relations),
+    _way_refs_position(0){}
+
+  // Node refs of all ways in the current buffer, with their inclusion
+  // status, consumed in order when handling ways.
+  std::vector<osmium::object_id_type> _way_refs;
+  std::vector<bool> _way_refs_inside;
+  std::size_t _way_refs_position;
+
+  // Look up all node refs of ways in buffer at once, as nodes are
+  // all checked already. Batch lookups overlap memory accesses.
+  void check_ways(const osmium::memory::Buffer& buffer){
+    _way_refs.clear();
+    for(const auto& way: buffer.select<osmium::Way>()){
+      for(const auto& node_ref: way.nodes()){
+        _way_refs.push_back(node_ref.ref());
+      }
     }
+    _inside_nodes.get_batch(_way_refs, _way_refs_inside);
+    _way_refs_position = 0;
   }
 
-  void way(osmium::Way& way){
+  void way(const osmium::Way& way){
     ++_all_ways;
-    // Only keep ways which have a node in the polygons.
+    const auto first = _way_refs_position;
+    const auto last = first + way.nodes().size();
+    _way_refs_position = last;
+
+    // Only keep ways which have a node in the polygons (node
+    // inclusion has already been tested for the whole buffer).
     bool keep_way = false;
-    for (auto& node_ref: way.nodes()){
-      if(_inside_nodes.find(node_ref.ref()) != _inside_nodes.end()){
-        // This way contains a node in the polygons (node inclusion
-        // has already been tested during the first "node" pass).
+    for(auto i = first; i < last; ++i){
+      if(_way_refs_inside[i]){
         keep_way = true;
         break;
       }
     }
 
     if(keep_way){
-      _inside_ways.insert(way.id());
+      _inside_ways.set(way.id());
 
       // Remember outside nodes needed to keep the way complete.
-      for (auto& node_ref : way.nodes()){
-        if(_inside_nodes.find(node_ref.ref()) == _inside_nodes.end()){
-          _outside_nodes.insert(node_ref.ref());
+      for(auto i = first; i < last; ++i){
+        if(!_way_refs_inside[i]){
+          _outside_nodes.set(_way_refs[i]);
         }
       }
     }
   }
 
-  void relation(osmium::Relation& relation){
+  void relation(const osmium::Relation& relation){
     ++_all_relations;
     // Keep relations which have a node in the polygons.
     for (auto& rm: relation.members()){
       if((rm.type() == osmium::item_type::node
-          and _inside_nodes.find(static_cast<osmium::unsigned_object_id_type>(rm.ref()))
-          != _inside_nodes.end())
+          and _inside_nodes.get(rm.ref()))
          // Keep relations that have a node member in the polygons.
          or (rm.type() == osmium::item_type::way
-             and _inside_ways.find(static_cast<osmium::unsigned_object_id_type>(rm.ref()))
-             != _inside_ways.end())
+             and _inside_ways.get(rm.ref()))
          // Also keep relations that have a way member in the polygons.
          ){
-        _inside_relations.insert(relation.id());
+        _inside_relations.set(relation.id());
         break;
       }
     }
   }
 };
 
-struct filter_handler : public osmium::handler::Handler{
-  const std::unordered_set<osmium::object_id_type>& _inside_nodes;
-  const std::unordered_set<osmium::object_id_type>& _outside_nodes;
-  const std::unordered_set<osmium::object_id_type>& _inside_ways;
-  const std::unordered_set<osmium::object_id_type>& _inside_relations;
-  osmium::io::Writer& _writer;
-
-  filter_handler(const std::unordered_set<osmium::object_id_type>& inside_nodes,
-                 const std::unordered_set<osmium::object_id_type>& outside_nodes,
-                 const std::unordered_set<osmium::object_id_type>& inside_ways,
-                 const std::unordered_set<osmium::object_id_type>& inside_relations,
-                 osmium::io::Writer& writer):
+// Ids of objects to keep for an extract, filled during the first
+// pass.
+struct extract_check{
+  // Used to keep track of nodes that are inside the polygons.
+  std::unique_ptr<id_set> _inside_nodes;
+
+  // Used to keep track of nodes that are outside the polygons BUT in
+  // an inside way (with another node inside the polygons).
+  std::unique_ptr<id_set> _outside_nodes;
+
+  // Used to keep track of inside ways.
+  std::unique_ptr<id_set> _inside_ways;
+
+  // Used to keep track of inside relations.
+  std::unique_ptr<id_set> _inside_relations;
+
+  // First pass only, both referencing the id sets above: released
+  // before the id sets get replaced.
+  std::unique_ptr<parallel_node_checker> _node_checker;
+  std::unique_ptr<polygon_check_handler> _polygon_handler;
+
+  extract_check(const extract& e,
+                const std::string& id_set_name,
+                unsigned threads):
+    _inside_nodes(make_id_set(id_set_name)),
+    _outside_nodes(make_id_set(id_set_name)),
+    _inside_ways(make_id_set(id_set_name)),
+    _inside_relations(make_id_set(id_set_name)),
+    _node_checker(new parallel_node_checker(e.polygons,
+                                            e.index,
+                                            *_inside_nodes,
+                                            threads)),
+    _polygon_handler(new polygon_check_handler(*_inside_nodes,
+                                               *_outside_nodes,
+                                               *_inside_ways,
+                                               *_inside_relations)){}
+
+  // Handle ways and relations in buffer, once all node checks are
+  // done.
+  void check_ways(const osmium::memory::Buffer& buffer){
+    _polygon_handler->check_ways(buffer);
+    osmium::apply(buffer, *_polygon_handler);
+  }
+};
+
+// Objects to keep, looked up in id sets.
+struct id_filter{
+  const id_set& _inside_nodes;
+  const id_set& _outside_nodes;
+  const id_set& _inside_ways;
+  const id_set& _inside_relations;
+
+  id_filter(const id_set& inside_nodes,
+            const id_set& outside_nodes,
+            const id_set& inside_ways,
+            const id_set& inside_relations):
     _inside_nodes(inside_nodes),
     _outside_nodes(outside_nodes),
     _inside_ways(inside_ways),
-    _inside_relations(inside_relations),
-    _writer(writer){}
+    _inside_relations(inside_relations){}
 
-  void node(osmium::Node& node){
-    // Inside nodes could be written during the inclusion check pass,
-    // but writing all nodes at once avoids messing the ordering.
-    if((_inside_nodes.find(node.id()) != _inside_nodes.end())
-       or (_outside_nodes.find(node.id()) != _outside_nodes.end())){
-      _writer(std::move(node));
+  bool operator()(osmium::item_type type, osmium::object_id_type id) const{
+    switch(type){
+    case osmium::item_type::node:
+      // Inside nodes could be written during the inclusion check
+      // pass, but writing all nodes at once avoids messing the
+      // ordering.
+      return _inside_nodes.get(id) or _outside_nodes.get(id);
+    case osmium::item_type::way:
+      return _inside_ways.get(id);
+    case osmium::item_type::relation:
+      return _inside_relations.get(id);
+    default:
+      return false;
     }
   }
+};
 
-  void way(osmium::Way& way){
-    if(_inside_ways.find(way.id()) != _inside_ways.end()){
-      _writer(std::move(way));
+// Same as id_filter for sorted input, checking ids against sorted
+// vectors. Ids of each type have to come in ascending order.
+struct sorted_id_filter{
+  const sorted_ids& _nodes;
+  const sorted_ids& _ways;
+  const sorted_ids& _relations;
+  std::size_t _node_position;
+  std::size_t _way_position;
+  std::size_t _relation_position;
+
+  sorted_id_filter(const sorted_ids& nodes,
+                   const sorted_ids& ways,
+                   const sorted_ids& relations):
+    _nodes(nodes),
+    _ways(ways),
+    _relations(relations),
+    _node_position(0),
+    _way_position(0),
+    _relation_position(0){}
+
+  bool operator()(osmium::item_type type, osmium::object_id_type id){
+    switch(type){
+    case osmium::item_type::node:
+      return _nodes.get(id, _node_position);
+    case osmium::item_type::way:
+      return _ways.get(id, _way_position);
+    case osmium::item_type::relation:
+      return _relations.get(id, _relation_position);
+    default:
+      return false;
     }
   }
+};
+
+// Objects kept by any of several filters, for the decoder to skip
+// objects no extract wants.
+template<class Filter>
+struct any_filter{
+  std::vector<Filter> _filters;
 
-  void relation(osmium::Relation& relation){
-    if(_inside_relations.find(relation.id()) != _inside_relations.end()){
-      _writer(std::move(relation));
+  any_filter(const std::vector<Filter>& filters):
+    _filters(filters){}
+
+  bool operator()(osmium::item_type type, osmium::object_id_type id){
+    for(auto& filter: _filters){
+      if(filter(type, id)){
+        return true;
+      }
     }
+    return false;
   }
 };
 
-int parse_file(std::string input_name,
-               std::string output_name,
-               const std::vector<polygon>& polygons,
-               const rtree_t& rtree){
-  // Used to keep track of nodes that are inside the polygons.
-  std::unordered_set<osmium::object_id_type> inside_nodes;
+// Copy objects kept by filter from the buffers it is applied to into
+// an output buffer.
+template<class Filter>
+struct filter_handler : public osmium::handler::Handler{
+  Filter _filter;
+  osmium::memory::Buffer _output;
 
-  // Used to keep track of nodes that are outside the polygons BUT in
-  // an inside way (with another node inside the polygons).
-  std::unordered_set<osmium::object_id_type> outside_nodes;
+  filter_handler(const Filter& filter, std::size_t capacity):
+    _filter(filter),
+    _output(capacity, osmium::memory::Buffer::auto_grow::yes){}
 
-  // Used to keep track of inside ways.
-  std::unordered_set<osmium::object_id_type> inside_ways;
+  void osm_object(const osmium::OSMObject& object){
+    if(_filter(object.type(), object.id())){
+      _output.add_item(object);
+      _output.commit();
+    }
+  }
+};
 
-  // Used to keep track of inside relations.
-  std::unordered_set<osmium::object_id_type> inside_relations;
+// Write objects kept by filters[e] from each buffer returned by read()
+// to writers[e], until a null buffer. With several threads, up to
+// twice as many buffers are filtered at once on the osmium thread
+// pool, filtered buffers being written in input order.
+template<class Read, class Filter>
+static void write_filtered(Read read,
+                           const std::vector<std::unique_ptr<osmium::io::Writer>>& writers,
+                           const std::vector<Filter>& filters,
+                           unsigned threads){
+  auto filter_buffer = [](const Filter& filter,
+                          const osmium::memory::Buffer& buffer){
+    filter_handler<Filter> handler(filter, buffer.committed());
+    osmium::apply(buffer, handler);
+    return std::move(handler._output);
+  };
+  auto write = [&writers](std::size_t e, osmium::memory::Buffer&& buffer){
+    if(buffer.committed() > 0){
+      (*writers[e])(std::move(buffer));
+    }
+  };
+
+  if(threads <= 1){
+    while(const auto buffer = read()){
+      for(std::size_t e = 0; e < filters.size(); ++e){
+        write(e, filter_buffer(filters[e], *buffer));
+      }
+    }
+    return;
+  }
+
+  // Filtered buffers for each extract, per read buffer.
+  std::deque<std::vector<std::future<osmium::memory::Buffer>>> pending;
+  auto write_front = [&](){
+    for(std::size_t e = 0; e < filters.size(); ++e){
+      write(e, pending.front()[e].get());
+    }
+    pending.pop_front();
+  };
+
+  while(const auto buffer = read()){
+    if(pending.size() >= 2 * threads){
+      write_front();
+    }
+    pending.emplace_back();
+    for(const auto& filter: filters){
+      pending.back().push_back(osmium::thread::Pool::instance().submit([filter_buffer, &filter, buffer]{
+            return filter_buffer(filter, *buffer);
+          }));
+    }
+  }
+  while(!pending.empty()){
+    write_front();
+  }
+}
+
+static void write_blob(osmium::io::Writer& writer, pbf_blob& blob){
+  if(blob.buffer.committed() > 0){
+    writer(std::move(blob.buffer));
+  }
+}
+
+static void write_blob(blob_writer& writer, pbf_blob& blob){
+  if(!blob.raw.empty()){
+    writer.write_raw(std::move(blob.raw));
+  }
+  else if(blob.buffer.committed() > 0){
+    writer(std::move(blob.buffer));
+  }
+}
+
+// Write objects kept by filter, other objects being skipped by the
+// PBF decoder without being built.
+template<class Output, class Filter>
+static void write_decoded(blob_reader& reader,
+                          Output& output,
+                          const Filter& filter){
+  reader.set_id_filter(filter);
+  pbf_blob blob;
+  while(reader.read(blob)){
+    write_blob(output, blob);
+  }
+}
+
+static bool only_nodes(const osmium::memory::Buffer& buffer){
+  for(const auto& item: buffer){
+    if(item.type() != osmium::item_type::node){
+      return false;
+    }
+  }
+  return true;
+}
+
+// Same checks as osmium::handler::CheckOrder for nodes decoded as ids
+// and locations, last_id being the largest node id so far.
+static void check_node_order(const node_locations& nodes,
+                             const osmium::handler::CheckOrder& check_order,
+                             osmium::object_id_type& last_id){
+  if(nodes.ids.empty()){
+    return;
+  }
+  if(check_order.max_way_id() > 0){
+    throw osmium::out_of_order_error("Found a node after a way.");
+  }
+  if(check_order.max_relation_id() > 0){
+    throw osmium::out_of_order_error("Found a node after a relation.");
+  }
+  for(auto id: nodes.ids){
+    if(last_id >= id){
+      throw osmium::out_of_order_error("Node IDs out of order.");
+    }
+    last_id = id;
+  }
+}
+
+// Drop the first count objects of buffer, count being decreased by
+// the number of objects dropped.
+static osmium::memory::Buffer skip_objects(osmium::memory::Buffer&& buffer,
+                                           std::size_t& count){
+  const std::size_t size = std::distance(buffer.begin(), buffer.end());
+  if(size <= count){
+    count -= size;
+    return osmium::memory::Buffer();
+  }
+  osmium::memory::Buffer rest(buffer.committed(),
+                              osmium::memory::Buffer::auto_grow::yes);
+  for(const auto& item: buffer){
+    if(count > 0){
+      --count;
+    }
+    else{
+      rest.add_item(item);
+      rest.commit();
+    }
+  }
+  return rest;
+}
+
+static double percentage(uint64_t part, uint64_t total){
+  return (total == 0) ? 0 : std::round(1000.0 * part / total) / 10;
+}
+
+static double megabytes(std::size_t bytes){
+  return std::round(10.0 * bytes / (1024 * 1024)) / 10;
+}
+
+int parse_file(std::string input_name,
+               const std::vector<extract>& extracts,
+               const std::string& id_set_name,
+               bool sorted_lookups,
+               unsigned threads,
+               std::size_t memory_budget){
+  std::vector<std::unique_ptr<extract_check>> checks;
+  for(const auto& e: extracts){
+    checks.emplace_back(new extract_check(e, id_set_name, threads));
+  }
+  const bool several = (extracts.size() > 1);
 
   // A pass through nodes to check for inclusion.
   osmium::io::File infile(input_name);
 
-  osmium::io::Reader reader_1(infile,
-                              osmium::osm_entity_bits::node
-                              | osmium::osm_entity_bits::way
-                              | osmium::osm_entity_bits::relation);
-
-  osmium::io::Header header = reader_1.header();
+  const auto read_types = osmium::osm_entity_bits::node
+    | osmium::osm_entity_bits::way
+    | osmium::osm_entity_bits::relation;
+
+  // Uncompressed PBF files are read blob by blob in order to record
+  // the ids in each blob, so that blobs without any wanted object can
+  // be skipped in the second pass. Only ids and locations of nodes are
+  // decoded, and no metadata is needed for this pass.
+  const bool pbf_blobs = is_seekable_pbf(infile);
+  std::unique_ptr<blob_reader> blobs_1;
+  std::unique_ptr<osmium::io::Reader> reader_1;
+  std::vector<blob_info> blob_index;
+
+  // Input kept in memory for the second pass while within budget,
+  // either PBF blobs as stored in the file, with empty strings for
+  // blobs to read again, or the first decoded buffers. Decoded
+  // buffers then need metadata.
+  std::vector<std::string> stored_blobs;
+  std::vector<std::shared_ptr<const osmium::memory::Buffer>> kept_buffers;
+  std::size_t kept_count = 0;
+  std::size_t kept_objects = 0;
+  std::size_t kept_size = 0;
+  bool over_budget = (memory_budget == 0);
+
+  osmium::io::Header header;
+  if(pbf_blobs){
+    blobs_1.reset(new blob_reader(input_name,
+                                  read_types,
+                                  osmium::io::read_meta::no,
+                                  true));
+    blobs_1->keep_raw(!over_budget);
+    header = blobs_1->header();
+  }
+  else{
+    reader_1.reset(new osmium::io::Reader(infile,
+                                          read_types,
+                                          over_budget ? osmium::io::read_meta::no
+                                                      : osmium::io::read_meta::yes));
+    header = reader_1->header();
+  }
   header.set("generator", "osmium-polygon");
 
-  osmium::io::Writer writer(output_name,
-                            header,
-                            osmium::io::overwrite::allow);
-
-  polygon_check_handler polygon_handler(polygons,
-                                        rtree,
-                                        inside_nodes,
-                                        outside_nodes,
-                                        inside_ways,
-                                        inside_relations);
+  auto read_1 = [&](node_locations& nodes){
+    if(!blobs_1){
+      return reader_1->read();
+    }
+    pbf_blob blob;
+    if(!blobs_1->read(blob)){
+      return osmium::memory::Buffer();
+    }
+    blob_index.push_back(blob.info);
+    if(memory_budget > 0){
+      if(!over_budget and (kept_size + blob.raw.size() <= memory_budget)){
+        ++kept_count;
+        kept_size += blob.raw.size();
+        stored_blobs.push_back(std::move(blob.raw));
+      }
+      else{
+        over_budget = true;
+        blobs_1->keep_raw(false);
+        stored_blobs.emplace_back();
+      }
+    }
+    nodes = std::move(blob.nodes);
+    return std::move(blob.buffer);
+  };
+
+  // PBF output from PBF input is written blob by blob, so that blobs
+  // whose objects are all kept can be copied without being decoded.
+  std::vector<std::unique_ptr<osmium::io::Writer>> writers;
+  std::unique_ptr<blob_writer> raw_writer;
+  for(const auto& e: extracts){
+    osmium::io::File outfile(e.output_name);
+    if(!several and pbf_blobs and is_seekable_pbf(outfile)){
+      raw_writer.reset(new blob_writer(outfile, header));
+    }
+    else{
+      writers.emplace_back(new osmium::io::Writer(outfile,
+                                                  header,
+                                                  osmium::io::overwrite::allow));
+    }
+  }
 
   std::cout << "[info] Checking inclusion for polygons in "
             << input_name
             << "..."
             << std::endl;
 
-  osmium::apply(reader_1, polygon_handler);
-  reader_1.close();
+  // Sorted lookups and skipping blobs in the second pass require ids
+  // in ascending order.
+  osmium::handler::CheckOrder check_order;
+  bool sorted = sorted_lookups or pbf_blobs;
 
-  std::cout << "* "
-            << inside_nodes.size()
-            << " nodes out of "
-            << polygon_handler._all_nodes
-            << " are inside."
-            << std::endl;
+  osmium::object_id_type last_node_id = std::numeric_limits<osmium::object_id_type>::min();
 
-  std::cout << "* "
-            << inside_ways.size()
-            << " ways out of "
-            << polygon_handler._all_ways
-            << " are inside."
-            << std::endl;
+  while(true){
+    // Shared with node checks running in other threads.
+    auto nodes = std::make_shared<node_locations>();
+    osmium::memory::Buffer read_buffer = read_1(*nodes);
+    if(!read_buffer){
+      break;
+    }
+    const auto buffer = std::make_shared<const osmium::memory::Buffer>(std::move(read_buffer));
+
+    if(reader_1 and !over_budget){
+      if(kept_size + buffer->capacity() <= memory_budget){
+        ++kept_count;
+        kept_size += buffer->capacity();
+        kept_objects += std::distance(buffer->begin(), buffer->end());
+        kept_buffers.push_back(buffer);
+      }
+      else{
+        over_budget = true;
+      }
+    }
 
-  std::cout << "* "
-            << inside_relations.size()
-            << " relations out of "
-            << polygon_handler._all_relations
-            << " are inside."
-            << std::endl;
+    // Nodes are checked for the whole buffer before ways and
+    // relations are handled.
+    for(auto& check: checks){
+      if(nodes->ids.empty()){
+        check->_node_checker->check(buffer);
+      }
+      else{
+        check->_node_checker->check(std::shared_ptr<const node_locations>(nodes));
+      }
+    }
 
-  std::cout << "* To ensure way completeness, "
-            << outside_nodes.size()
-            << " nodes outside polygon(s) should be added."
-            << std::endl;
+    if(!only_nodes(*buffer)){
+      // All node checks have to be done before looking at way refs.
+      for(auto& check: checks){
+        check->_node_checker->wait();
+      }
+      if(several and (threads > 1)){
+        // Extracts fill their own sets, so their ways can be handled
+        // at the same time.
+        std::vector<std::future<void>> handled;
+        for(auto& check: checks){
+          extract_check* c = check.get();
+          handled.push_back(osmium::thread::Pool::instance().submit([c, buffer]{
+                c->check_ways(*buffer);
+              }));
+        }
+        for(auto& h: handled){
+          h.get();
+        }
+      }
+      else{
+        for(auto& check: checks){
+          check->check_ways(*buffer);
+        }
+      }
+    }
+
+    if(sorted){
+      try{
+        check_node_order(*nodes, check_order, last_node_id);
+        osmium::apply(*buffer, check_order);
+      }
+      catch(const osmium::out_of_order_error& e){
+        if(sorted_lookups){
+          std::cout << "[warning] "
+                    << e.what()
+                    << " Falling back to id sets for filtering."
+                    << std::endl;
+        }
+        sorted = false;
+      }
+    }
+  }
+  for(auto& check: checks){
+    check->_node_checker->wait();
+  }
+  if(reader_1){
+    reader_1->close();
+  }
+
+  for(std::size_t e = 0; e < extracts.size(); ++e){
+    auto& check = *checks[e];
+    if(several){
+      std::cout << "[info] Extract for "
+                << extracts[e].output_name
+                << ":"
+                << std::endl;
+    }
+
+    const auto& node_stats = check._node_checker->statistics();
+    std::cout << "* "
+              << check._inside_nodes->size()
+              << " nodes out of "
+              << node_stats.nodes
+              << " are inside."
+              << std::endl;
+
+    std::cout << "* Cell cache hit rate: "
+              << percentage(node_stats.cache_hits, node_stats.nodes)
+              << "%, "
+              << percentage(node_stats.cache_answers, node_stats.nodes)
+              << "% of nodes located without checking polygons."
+              << std::endl;
+
+    std::cout << "* "
+              << check._inside_ways->size()
+              << " ways out of "
+              << check._polygon_handler->_all_ways
+              << " are inside."
+              << std::endl;
+
+    std::cout << "* "
+              << check._inside_relations->size()
+              << " relations out of "
+              << check._polygon_handler->_all_relations
+              << " are inside."
+              << std::endl;
+
+    std::cout << "* To ensure way completeness, "
+              << check._outside_nodes->size()
+              << " nodes outside polygon(s) should be added."
+              << std::endl;
+
+    check._node_checker.reset();
+    check._polygon_handler.reset();
+
+    // Pick the most compact implementation now that all ids are
+    // known.
+    check._inside_nodes = select_id_set(id_set_name, std::move(check._inside_nodes));
+    check._outside_nodes = select_id_set(id_set_name, std::move(check._outside_nodes));
+    check._inside_ways = select_id_set(id_set_name, std::move(check._inside_ways));
+    check._inside_relations = select_id_set(id_set_name, std::move(check._inside_relations));
+
+    std::cout << "* Id sets use "
+              << megabytes(check._inside_nodes->memory()
+                           + check._outside_nodes->memory()
+                           + check._inside_ways->memory()
+                           + check._inside_relations->memory())
+              << "MB (nodes: "
+              << check._inside_nodes->name()
+              << ", outside nodes: "
+              << check._outside_nodes->name()
+              << ", ways: "
+              << check._inside_ways->name()
+              << ", relations: "
+              << check._inside_relations->name()
+              << ")."
+              << std::endl;
+  }
+
+  if(memory_budget > 0){
+    std::cout << "* "
+              << kept_count
+              << (pbf_blobs ? " blobs" : " buffers")
+              << " kept in memory ("
+              << megabytes(kept_size)
+              << "MB), "
+              << (over_budget ? "reading the rest of the input again." : "skipping the second read.")
+              << std::endl;
+  }
 
   // Now writing everything with filtering based on the previous
   // inclusion checks.
-  filter_handler filter(inside_nodes,
-                        outside_nodes,
-                        inside_ways,
-                        inside_relations,
-                        writer);
-
-  osmium::io::Reader reader_2(infile,
-                              osmium::osm_entity_bits::node
-                              | osmium::osm_entity_bits::way
-                              | osmium::osm_entity_bits::relation);
-
-  std::cout << "[info] writing down extract in "
-            << output_name
-            << std::endl;
+  std::unique_ptr<blob_reader> blobs_2;
+  std::unique_ptr<osmium::io::Reader> reader_2;
+
+  if(pbf_blobs){
+    // All blobs are read again unless ids are sorted.
+    std::vector<blob_info> wanted_blobs;
+    std::vector<std::string> wanted_stored;
+    if(sorted){
+      // Objects wanted by several extracts are counted several times.
+      for(const auto& check: checks){
+        mark_wanted(blob_index, osmium::item_type::node, *check->_inside_nodes);
+        mark_wanted(blob_index, osmium::item_type::node, *check->_outside_nodes);
+        mark_wanted(blob_index, osmium::item_type::way, *check->_inside_ways);
+        mark_wanted(blob_index, osmium::item_type::relation, *check->_inside_relations);
+      }
+
+      std::size_t complete_blobs = 0;
+      // Blobs without wanted objects are dropped from memory.
+      for(std::size_t b = 0; b < blob_index.size(); ++b){
+        const auto& blob = blob_index[b];
+        if(blob.max_wanted > 0){
+          wanted_blobs.push_back(blob);
+          if(!stored_blobs.empty()){
+            wanted_stored.push_back(std::move(stored_blobs[b]));
+          }
+          if(blob.max_wanted == blob.count()){
+            ++complete_blobs;
+          }
+        }
+      }
+      std::vector<std::string>().swap(stored_blobs);
+
+      std::cout << "* "
+                << wanted_blobs.size()
+                << " blobs out of "
+                << blob_index.size()
+                << " may hold wanted objects";
+      if(!several){
+        std::cout << ", "
+                  << complete_blobs
+                  << " may hold only wanted objects";
+      }
+      std::cout << "." << std::endl;
+    }
+    else{
+      wanted_blobs = std::move(blob_index);
+      wanted_stored = std::move(stored_blobs);
+    }
+
+    // Wanted counts are only known for sorted ids.
+    blobs_2.reset(new blob_reader(input_name,
+                                  read_types,
+                                  osmium::io::read_meta::yes,
+                                  wanted_blobs,
+                                  raw_writer and sorted));
+    blobs_2->set_stored(std::move(wanted_stored));
+  }
+  else if(over_budget){
+    reader_2.reset(new osmium::io::Reader(infile, read_types));
+  }
+
+  // Kept buffers come first, then objects after them are read again.
+  std::size_t next_kept = 0;
+  auto read_2 = [&]() -> std::shared_ptr<const osmium::memory::Buffer>{
+    if(next_kept < kept_buffers.size()){
+      return std::move(kept_buffers[next_kept++]);
+    }
+    while(reader_2){
+      osmium::memory::Buffer buffer = reader_2->read();
+      if(!buffer){
+        break;
+      }
+      if(kept_objects > 0){
+        buffer = skip_objects(std::move(buffer), kept_objects);
+      }
+      if(buffer.committed() > 0){
+        return std::make_shared<const osmium::memory::Buffer>(std::move(buffer));
+      }
+    }
+    return nullptr;
+  };
+
+  // Objects to drop are skipped while decoding PBF blobs, and
+  // filtered out of read buffers otherwise. Objects for several
+  // extracts are decoded once and dispatched to each extract.
+  auto write = [&](const auto& filters){
+    using filter_type = typename std::decay_t<decltype(filters)>::value_type;
+    if(raw_writer){
+      write_decoded(*blobs_2, *raw_writer, filters.front());
+    }
+    else if(blobs_2 and !several){
+      write_decoded(*blobs_2, *writers.front(), filters.front());
+    }
+    else if(blobs_2){
+      blobs_2->set_id_filter(any_filter<filter_type>(filters));
+      write_filtered([&]() -> std::shared_ptr<const osmium::memory::Buffer>{
+          pbf_blob blob;
+          if(!blobs_2->read(blob)){
+            return nullptr;
+          }
+          return std::make_shared<const osmium::memory::Buffer>(std::move(blob.buffer));
+        },
+        writers,
+        filters,
+        threads);
+    }
+    else{
+      write_filtered(read_2, writers, filters, threads);
+    }
+  };
+
+  for(const auto& e: extracts){
+    std::cout << "[info] writing down extract in "
+              << e.output_name
+              << std::endl;
+  }
 
-  osmium::apply(reader_2, filter);
+  if(sorted and sorted_lookups){
+    // Filters refer to vectors elements, that are not reallocated.
+    std::vector<sorted_ids> nodes;
+    std::vector<sorted_ids> ways;
+    std::vector<sorted_ids> relations;
+    nodes.reserve(checks.size());
+    ways.reserve(checks.size());
+    relations.reserve(checks.size());
+    std::size_t memory = 0;
+    for(auto& check: checks){
+      nodes.emplace_back(std::vector<const id_set*>({check->_inside_nodes.get(),
+                                                      check->_outside_nodes.get()}));
+      ways.emplace_back(std::vector<const id_set*>({check->_inside_ways.get()}));
+      relations.emplace_back(std::vector<const id_set*>({check->_inside_relations.get()}));
+      memory += nodes.back().memory() + ways.back().memory() + relations.back().memory();
+
+      // Sets are no longer needed.
+      check->_inside_nodes.reset();
+      check->_outside_nodes.reset();
+      check->_inside_ways.reset();
+      check->_inside_relations.reset();
+    }
+
+    std::cout << "* Sorted ids use "
+              << megabytes(memory)
+              << "MB."
+              << std::endl;
+
+    std::vector<sorted_id_filter> filters;
+    for(std::size_t e = 0; e < checks.size(); ++e){
+      filters.emplace_back(nodes[e], ways[e], relations[e]);
+    }
+    write(filters);
+  }
+  else{
+    std::vector<id_filter> filters;
+    for(const auto& check: checks){
+      filters.emplace_back(*check->_inside_nodes,
+                           *check->_outside_nodes,
+                           *check->_inside_ways,
+                           *check->_inside_relations);
+    }
+    write(filters);
+  }
+
+  if(raw_writer){
+    raw_writer->close();
+  }
+  for(auto& writer: writers){
+    writer->close();
+  }
 
   return 0;
 }
@@ -10,10 +10,15 @@ All rights reserved (see LICENSE).
 #ifndef OSM_PARSER_H
 #define OSM_PARSER_H
 
+#include <cmath>
 #include <cstdio>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <string>
 #include <vector>
 #include <algorithm>
-#include <unordered_set>
+#include <limits>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
 #include <osmium/handler.hpp>
@@ -23,25 +28,33 @@ All rights reserved (see LICENSE).
 #include <osmium/builder/attr.hpp>
 #include <osmium/index/map/sparse_mem_array.hpp>
 #include <osmium/handler/node_locations_for_ways.hpp>
-#include <boost/geometry.hpp>
-#include <boost/geometry/geometries/point.hpp>
-#include <boost/geometry/geometries/box.hpp>
-#include <boost/geometry/index/rtree.hpp>
-#include "polygon.h"
-
-namespace bg = boost::geometry;
-namespace bgi = boost::geometry::index;
-
-typedef bg::model::point<float, 2, bg::cs::cartesian> point;
-typedef bg::model::box<point> box;
-typedef std::pair<box, unsigned> value;
-typedef bgi::rtree<value, bgi::rstar<16>> rtree_t;
+#include <osmium/handler/check_order.hpp>
+#include <osmium/thread/pool.hpp>
+#include "polygon_set.h"
+#include "cell_covering.h"
+#include "id_set.h"
+#include "node_checker.h"
+#include "pbf_blobs.h"
+#include "polygon_index.h"
 
 typedef osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location> index_pos_type;
 
+// Objects to write to output_name, with regard to inclusion in
+// polygons.
+struct extract{
+  std::string output_name;
+  const polygon_set& polygons;
+  const polygon_index& index;
+};
+
+// Write all extracts in the same two passes over input_name. Up to
+// memory_budget bytes of input are kept in memory between passes
+// instead of being read again.
 int parse_file(std::string input_name,
-               std::string output_name,
-               const std::vector<polygon>& polygons,
-               const rtree_t& rtree);
+               const std::vector<extract>& extracts,
+               const std::string& id_set_name,
+               bool sorted_lookups,
+               unsigned threads,
+               std::size_t memory_budget);
 
 #endif
@@ -0,0 +1,294 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "packed_rtree.h"
+
+// Maximum number of edges in a chunk.
+constexpr std::size_t chunk_edges = 8;
+
+// Maximum number of children of a node.
+constexpr std::size_t node_capacity = 16;
+
+template<class Entry>
+static int64_t center_x(const Entry& entry){
+  return static_cast<int64_t>(entry.min_x) + entry.max_x;
+}
+
+template<class Entry>
+static int64_t center_y(const Entry& entry){
+  return static_cast<int64_t>(entry.min_y) + entry.max_y;
+}
+
+// Order entries so that groups of node_capacity consecutive entries
+// are spatially close: sort by x, cut in vertical slices, then sort
+// each slice by y.
+template<class Entry>
+static void str_sort(std::vector<Entry>& entries){
+  const std::size_t groups = (entries.size() + node_capacity - 1) / node_capacity;
+  const std::size_t slices
+    = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(groups))));
+  const std::size_t slice_size = slices * node_capacity;
+
+  std::sort(entries.begin(),
+            entries.end(),
+            [](const Entry& lhs, const Entry& rhs){
+              return center_x(lhs) < center_x(rhs);
+            });
+  for(std::size_t first = 0; first < entries.size(); first += slice_size){
+    const std::size_t last = std::min(first + slice_size, entries.size());
+    std::sort(entries.begin() + first,
+              entries.begin() + last,
+              [](const Entry& lhs, const Entry& rhs){
+                return center_y(lhs) < center_y(rhs);
+              });
+  }
+}
+
+// Append to parents one node for each group of node_capacity
+// consecutive entries, entries starting at offset in their storage.
+template<class Entry, class Node>
+static void pack(const std::vector<Entry>& entries,
+                 std::size_t offset,
+                 std::vector<Node>& parents){
+  for(std::size_t first = 0; first < entries.size(); first += node_capacity){
+    const std::size_t last = std::min(first + node_capacity, entries.size());
+    Node parent{entries[first].min_x,
+                entries[first].min_y,
+                entries[first].max_x,
+                entries[first].max_y,
+                static_cast<uint32_t>(offset + first),
+                static_cast<uint32_t>(offset + last)};
+    for(std::size_t i = first + 1; i < last; ++i){
+      parent.min_x = std::min(parent.min_x, entries[i].min_x);
+      parent.min_y = std::min(parent.min_y, entries[i].min_y);
+      parent.max_x = std::max(parent.max_x, entries[i].max_x);
+      parent.max_y = std::max(parent.max_y, entries[i].max_y);
+    }
+    parents.push_back(parent);
+  }
+}
+
+// Same as osmium::Box::contains, without asserting that loc is a
+// valid location as cell corners may not be.
+static bool in_box(const osmium::Box& box, const osmium::Location& loc){
+  return (box.bottom_left().x() <= loc.x()) and (loc.x() <= box.top_right().x())
+    and (box.bottom_left().y() <= loc.y()) and (loc.y() <= box.top_right().y());
+}
+
+packed_rtree::packed_rtree():
+  _leaf_nodes(0),
+  _polygon_offsets(1, 0){}
+
+packed_rtree::packed_rtree(const polygon_set& polygons):
+  _leaf_nodes(0),
+  _polygon_offsets(1, 0){
+  for(uint32_t p = 0; p < polygons.size(); ++p){
+    bool wide = false;
+    for(std::size_t ring = 0; ring < polygons.rings_number(p); ++ring){
+      const uint32_t r = _ring_bboxes.size();
+      const osmium::Box& bbox = polygons.ring_bbox(p, ring);
+      _ring_bboxes.push_back(bbox);
+      _ring_polygons.push_back(p);
+      wide |= (static_cast<int64_t>(bbox.top_right().x()) - bbox.bottom_left().x()
+               > std::numeric_limits<int32_t>::max());
+
+      const int32_t* xs = polygons.ring_xs(p, ring);
+      const int32_t* ys = polygons.ring_ys(p, ring);
+      const std::size_t edges_number = polygons.ring_size(p, ring) - 1;
+      for(std::size_t first = 0; first < edges_number; first += chunk_edges){
+        const std::size_t last = std::min(first + chunk_edges, edges_number);
+        chunk c{xs[first], ys[first], xs[first], ys[first], p, r, 0, 0};
+        for(std::size_t i = first + 1; i <= last; ++i){
+          c.min_x = std::min(c.min_x, xs[i]);
+          c.min_y = std::min(c.min_y, ys[i]);
+          c.max_x = std::max(c.max_x, xs[i]);
+          c.max_y = std::max(c.max_y, ys[i]);
+        }
+        c.first = first;
+        c.last = last;
+        _chunks.push_back(c);
+      }
+    }
+    _polygon_offsets.push_back(_ring_bboxes.size());
+    if(wide){
+      _wide_polygons.push_back(p);
+    }
+  }
+  if(_chunks.empty()){
+    return;
+  }
+
+  // Chunks and their edges are stored in packing order.
+  str_sort(_chunks);
+  for(auto& c: _chunks){
+    const uint32_t p = _ring_polygons[c.ring];
+    const std::size_t ring = c.ring - _polygon_offsets[p];
+    const int32_t* xs = polygons.ring_xs(p, ring);
+    const int32_t* ys = polygons.ring_ys(p, ring);
+    const uint32_t first = _edges.size();
+    for(std::size_t i = c.first; i < c.last; ++i){
+      _edges.push_back(xs[i], ys[i], xs[i + 1], ys[i + 1]);
+    }
+    c.first = first;
+    c.last = _edges.size();
+  }
+
+  // Build levels from the leaves up, each level being sorted before
+  // packing its parents.
+  std::vector<node> level;
+  pack(_chunks, 0, level);
+  _leaf_nodes = level.size();
+  while(true){
+    str_sort(level);
+    const std::size_t offset = _nodes.size();
+    _nodes.insert(_nodes.end(), level.begin(), level.end());
+    if(level.size() == 1){
+      break;
+    }
+    std::vector<node> parents;
+    pack(level, offset, parents);
+    std::swap(level, parents);
+  }
+}
+
+bool packed_rtree::empty() const{
+  return _chunks.empty();
+}
+
+std::size_t packed_rtree::size() const{
+  return _chunks.size();
+}
+
+std::size_t packed_rtree::memory() const{
+  return _chunks.capacity() * sizeof(chunk)
+    + _nodes.capacity() * sizeof(node)
+    + 4 * _edges.x1.capacity() * sizeof(int32_t)
+    + (_polygon_offsets.capacity() + _ring_polygons.capacity()
+       + _wide_polygons.capacity()) * sizeof(uint32_t)
+    + _ring_bboxes.capacity() * sizeof(osmium::Box);
+}
+
+void packed_rtree::ring_windings(const osmium::Location& loc,
+                                 windings_t& windings) const{
+  windings.clear();
+  if(_nodes.empty()){
+    return;
+  }
+  // All edges crossing the horizontal half-line from loc to the
+  // right, the same ones that contribute when walking whole rings.
+  // Edges left of loc never count as crossings.
+  const node line{loc.x(),
+                  loc.y(),
+                  std::numeric_limits<int32_t>::max(),
+                  loc.y(),
+                  0,
+                  0};
+  auto add_chunk = [&](const chunk& c){
+    const int wn = _edges.winding_number(c.first, c.last, loc);
+    if(wn != 0){
+      windings.emplace_back(c.ring, wn);
+    }
+  };
+  if(intersects(_nodes.back(), line)){
+    visit(_nodes.size() - 1, line, add_chunk);
+  }
+
+  // Sum contributions of chunks from the same ring.
+  std::sort(windings.begin(), windings.end());
+  std::size_t size = 0;
+  for(std::size_t i = 0; i < windings.size(); ++i){
+    if((size > 0) and (windings[size - 1].first == windings[i].first)){
+      windings[size - 1].second += windings[i].second;
+      if(windings[size - 1].second == 0){
+        --size;
+      }
+    }
+    else{
+      windings[size++] = windings[i];
+    }
+  }
+  windings.resize(size);
+}
+
+template<class F>
+void packed_rtree::for_each_containing(const osmium::Location& loc,
+                                       windings_t& windings,
+                                       F f) const{
+  ring_windings(loc, windings);
+  // Rings of a polygon are contiguous, outer ring first.
+  auto w = windings.cbegin();
+  while(w != windings.cend()){
+    const uint32_t p = _ring_polygons[w->first];
+    bool contained = (w->first == _polygon_offsets[p])
+      and in_box(_ring_bboxes[w->first], loc);
+    for(; (w != windings.cend()) and (_ring_polygons[w->first] == p); ++w){
+      if((w->first != _polygon_offsets[p])
+         and in_box(_ring_bboxes[w->first], loc)){
+        // In a hole.
+        contained = false;
+      }
+    }
+    if(contained){
+      f(p);
+    }
+  }
+}
+
+bool packed_rtree::contains(const osmium::Location& loc,
+                            windings_t& windings) const{
+  bool contained = false;
+  for_each_containing(loc,
+                      windings,
+                      [&](uint32_t){
+                        contained = true;
+                      });
+  return contained;
+}
+
+box_position packed_rtree::classify(const osmium::Box& box,
+                                    std::vector<uint32_t>& ranks,
+                                    windings_t& windings) const{
+  ranks.clear();
+  query(box,
+        [&](const chunk& c){
+          ranks.push_back(c.polygon);
+        });
+  for(auto p: _wide_polygons){
+    const osmium::Box& bbox = _ring_bboxes[_polygon_offsets[p]];
+    if((bbox.bottom_left().x() <= box.top_right().x())
+       and (box.bottom_left().x() <= bbox.top_right().x())
+       and (bbox.bottom_left().y() <= box.top_right().y())
+       and (box.bottom_left().y() <= bbox.top_right().y())){
+      ranks.push_back(p);
+    }
+  }
+  std::sort(ranks.begin(), ranks.end());
+  ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+
+  // No edge of other polygons crosses box, so its corner tells
+  // whether box is in one of them, if any.
+  bool inside = false;
+  if(ranks.size() + 1 < _polygon_offsets.size()){
+    for_each_containing(box.bottom_left(),
+                        windings,
+                        [&](uint32_t p){
+                          inside |= !std::binary_search(ranks.begin(),
+                                                        ranks.end(),
+                                                        p);
+                        });
+  }
+  if(inside){
+    ranks.clear();
+    return box_position::inside;
+  }
+  return ranks.empty() ? box_position::outside : box_position::boundary;
+}
@@ -0,0 +1,146 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef PACKED_RTREE_H
+#define PACKED_RTREE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include "polygon_set.h"
+#include "winding.h"
+
+// Static R-tree bulk loaded with Sort-Tile-Recursive packing. Leaf
+// entries are bounding boxes of short chunks of consecutive ring
+// edges, tagged with the polygon they belong to, so that thin or
+// concave polygons are only reported close to their boundary. The
+// winding number of a location is computed from the few chunks
+// crossing the horizontal half-line from it to the right.
+class packed_rtree{
+public:
+  // Edges of a chunk are in [first, last) in the edge arrays, ring
+  // being numbered across all polygons.
+  struct chunk{
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+    uint32_t polygon;
+    uint32_t ring;
+    uint32_t first;
+    uint32_t last;
+  };
+
+  // Non-zero winding numbers of rings, used as scratch space for
+  // queries.
+  typedef std::vector<std::pair<uint32_t, int>> windings_t;
+
+private:
+  // Children of node k are chunks in [first, last) for the first
+  // _leaf_nodes nodes, nodes in [first, last) for the others. The
+  // root is the last node.
+  struct node{
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+    uint32_t first;
+    uint32_t last;
+  };
+
+  std::vector<chunk> _chunks;
+  std::vector<node> _nodes;
+  std::size_t _leaf_nodes;
+  edge_arrays _edges;
+
+  // Rings of polygon p are in [_polygon_offsets[p],
+  // _polygon_offsets[p + 1]), outer ring first.
+  std::vector<uint32_t> _polygon_offsets;
+  std::vector<uint32_t> _ring_polygons;
+  std::vector<osmium::Box> _ring_bboxes;
+
+  // Polygons with a ring wider than the int32 range, for which exact
+  // geometry does not match the wrapping winding number computation.
+  std::vector<uint32_t> _wide_polygons;
+
+  template<class Box, class F>
+  void visit(std::size_t k, const Box& box, F& f) const{
+    const node& n = _nodes[k];
+    for(uint32_t c = n.first; c < n.last; ++c){
+      if(k < _leaf_nodes){
+        const chunk& leaf = _chunks[c];
+        if(intersects(leaf, box)){
+          f(leaf);
+        }
+      }
+      else if(intersects(_nodes[c], box)){
+        visit(c, box, f);
+      }
+    }
+  }
+
+  template<class Entry, class Box>
+  static bool intersects(const Entry& entry, const Box& box){
+    return (entry.min_x <= box.max_x) and (box.min_x <= entry.max_x)
+      and (entry.min_y <= box.max_y) and (box.min_y <= entry.max_y);
+  }
+
+  // Fill windings with the non-zero winding numbers of loc for all
+  // rings, sorted by ring.
+  void ring_windings(const osmium::Location& loc, windings_t& windings) const;
+
+  // Call f with the rank of each polygon containing loc.
+  template<class F>
+  void for_each_containing(const osmium::Location& loc,
+                           windings_t& windings,
+                           F f) const;
+
+public:
+  packed_rtree();
+
+  packed_rtree(const polygon_set& polygons);
+
+  bool empty() const;
+
+  // Number of chunks.
+  std::size_t size() const;
+
+  // Approximate heap memory used, in bytes.
+  std::size_t memory() const;
+
+  // Call f for all chunks whose bounding box intersects box.
+  template<class F>
+  void query(const osmium::Box& box, F f) const{
+    if(_nodes.empty()){
+      return;
+    }
+    const node range{box.bottom_left().x(),
+                     box.bottom_left().y(),
+                     box.top_right().x(),
+                     box.top_right().y(),
+                     0,
+                     0};
+    if(intersects(_nodes.back(), range)){
+      visit(_nodes.size() - 1, range, f);
+    }
+  }
+
+  bool contains(const osmium::Location& loc, windings_t& windings) const;
+
+  // Inclusion status of box in the union of polygons. Polygons whose
+  // boundary may cross box are stored in ranks, sorted, for boundary
+  // boxes.
+  box_position classify(const osmium::Box& box,
+                        std::vector<uint32_t>& ranks,
+                        windings_t& windings) const;
+};
+
+#endif
@@ -0,0 +1,389 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <protozero/pbf_message.hpp>
+#include <osmium/io/detail/protobuf_tags.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/util/config.hpp>
+#include "pbf_blobs.h"
+
+// Number of blobs being decoded or encoded ahead.
+static std::size_t max_queued_blobs(){
+  static const std::size_t max_size = osmium::config::get_max_queue_size("OSMDATA", 20);
+  return max_size;
+}
+
+id_range::id_range():
+  first(std::numeric_limits<osmium::object_id_type>::max()),
+  last(std::numeric_limits<osmium::object_id_type>::min()),
+  count(0){}
+
+void id_range::extend(osmium::object_id_type id){
+  first = std::min(first, id);
+  last = std::max(last, id);
+  ++count;
+}
+
+blob_info::blob_info():
+  offset(0),
+  size(0),
+  max_wanted(0){}
+
+id_range& blob_info::range(osmium::item_type type){
+  return ranges[osmium::item_type_to_nwr_index(type)];
+}
+
+const id_range& blob_info::range(osmium::item_type type) const{
+  return ranges[osmium::item_type_to_nwr_index(type)];
+}
+
+uint32_t blob_info::count() const{
+  return ranges[0].count + ranges[1].count + ranges[2].count;
+}
+
+bool is_seekable_pbf(const osmium::io::File& file){
+  return (file.format() == osmium::io::file_format::pbf)
+    and (file.compression() == osmium::io::file_compression::none)
+    and !file.filename().empty()
+    and (file.filename() != "-");
+}
+
+void mark_wanted(std::vector<blob_info>& blobs,
+                 osmium::item_type type,
+                 const id_set& ids){
+  std::vector<std::size_t> ranks;
+  for(std::size_t b = 0; b < blobs.size(); ++b){
+    if(blobs[b].range(type).count > 0){
+      ranks.push_back(b);
+    }
+  }
+
+  // Ids come in ascending order, as do blob ranges.
+  std::size_t r = 0;
+  ids.for_each([&](osmium::object_id_type id){
+      while((r < ranks.size()) and (blobs[ranks[r]].range(type).last < id)){
+        ++r;
+      }
+      if((r < ranks.size()) and (blobs[ranks[r]].range(type).first <= id)){
+        ++blobs[ranks[r]].max_wanted;
+      }
+    });
+}
+
+blob_reader::blob_reader(const std::string& file_name,
+                         osmium::osm_entity_bits::type read_types,
+                         osmium::io::read_meta read_meta,
+                         bool node_locations):
+  _input(file_name, std::ios::binary),
+  _read_types(read_types),
+  _read_meta(read_meta),
+  _node_locations(node_locations),
+  _all_blobs(true),
+  _next_blob(0),
+  _done(false),
+  _raw_complete(false),
+  _keep_raw(false){
+  if(!_input){
+    throw osmium::io_error("Unable to open " + file_name);
+  }
+  blob_info info;
+  std::string data;
+  if(!read_blob("OSMHeader", info, data)){
+    throw osmium::pbf_error("missing header blob");
+  }
+  _header = osmium::io::detail::decode_header(data);
+}
+
+blob_reader::blob_reader(const std::string& file_name,
+                         osmium::osm_entity_bits::type read_types,
+                         osmium::io::read_meta read_meta,
+                         const std::vector<blob_info>& blobs,
+                         bool raw_complete):
+  blob_reader(file_name, read_types, read_meta, false){
+  _all_blobs = false;
+  _blobs = blobs;
+  _raw_complete = raw_complete;
+}
+
+blob_reader::~blob_reader(){
+  for(auto& pending: _pending){
+    pending.wait();
+  }
+}
+
+// Size of a blob header from the four bytes preceding it.
+static uint32_t blob_header_size(const unsigned char* size_bytes){
+  // Network byte order.
+  const uint32_t header_size = (uint32_t(size_bytes[0]) << 24)
+    | (uint32_t(size_bytes[1]) << 16)
+    | (uint32_t(size_bytes[2]) << 8)
+    | uint32_t(size_bytes[3]);
+  if(header_size > static_cast<uint32_t>(osmium::io::detail::max_blob_header_size)){
+    throw osmium::pbf_error("invalid BlobHeader size (> max_blob_header_size)");
+  }
+  return header_size;
+}
+
+// Size of the blob data following header.
+static std::size_t blob_data_size(const std::string& header,
+                                  const char* expected_type){
+  protozero::data_view type;
+  std::size_t data_size = 0;
+  protozero::pbf_message<osmium::io::detail::FileFormat::BlobHeader> pbf_header(header);
+  while(pbf_header.next()){
+    switch(pbf_header.tag()){
+    case osmium::io::detail::FileFormat::BlobHeader::required_string_type:
+      type = pbf_header.get_view();
+      break;
+    case osmium::io::detail::FileFormat::BlobHeader::required_int32_datasize:
+      data_size = pbf_header.get_int32();
+      break;
+    default:
+      pbf_header.skip();
+    }
+  }
+  if((data_size == 0) or (data_size > osmium::io::detail::max_uncompressed_blob_size)){
+    throw osmium::pbf_error("invalid blob size: " + std::to_string(data_size));
+  }
+  if((type.size() != std::strlen(expected_type))
+     or std::strncmp(expected_type, type.data(), type.size())){
+    throw osmium::pbf_error("blob does not have expected type (OSMHeader in first blob, OSMData in following blobs)");
+  }
+  return data_size;
+}
+
+// Data of a whole blob kept in memory.
+static std::string stored_blob_data(const std::string& stored){
+  if(stored.size() < 4){
+    throw osmium::pbf_error("truncated stored blob");
+  }
+  const uint32_t header_size = blob_header_size(reinterpret_cast<const unsigned char*>(stored.data()));
+  if(stored.size() < 4 + header_size){
+    throw osmium::pbf_error("truncated stored blob");
+  }
+  const std::size_t data_size = blob_data_size(stored.substr(4, header_size), "OSMData");
+  if(stored.size() != 4 + header_size + data_size){
+    throw osmium::pbf_error("truncated stored blob");
+  }
+  return stored.substr(4 + header_size);
+}
+
+bool blob_reader::read_blob(const char* expected_type,
+                            blob_info& info,
+                            std::string& data,
+                            std::string* raw){
+  info.offset = static_cast<uint64_t>(_input.tellg());
+
+  unsigned char size_bytes[4];
+  _input.read(reinterpret_cast<char*>(size_bytes), sizeof(size_bytes));
+  if(_input.gcount() == 0){
+    return false;
+  }
+  if(_input.gcount() != sizeof(size_bytes)){
+    throw osmium::pbf_error("truncated data (EOF encountered)");
+  }
+  const uint32_t header_size = blob_header_size(size_bytes);
+
+  std::string header(header_size, '\0');
+  _input.read(&header[0], header_size);
+  if(static_cast<uint32_t>(_input.gcount()) != header_size){
+    throw osmium::pbf_error("truncated data (EOF encountered)");
+  }
+
+  const std::size_t data_size = blob_data_size(header, expected_type);
+
+  data.resize(data_size);
+  _input.read(&data[0], data_size);
+  if(static_cast<std::size_t>(_input.gcount()) != data_size){
+    throw osmium::pbf_error("truncated data (EOF encountered)");
+  }
+
+  info.size = sizeof(size_bytes) + header_size + data_size;
+
+  if(raw){
+    raw->reserve(info.size);
+    raw->assign(reinterpret_cast<const char*>(size_bytes), sizeof(size_bytes));
+    raw->append(header);
+    raw->append(data);
+  }
+  return true;
+}
+
+void blob_reader::fill(){
+  while(!_done and (_pending.size() < max_queued_blobs())){
+    blob_info info;
+    std::string data;
+    std::string raw;
+    bool verify_raw = false;
+    if(_all_blobs){
+      if(!read_blob("OSMData", info, data, _keep_raw ? &raw : nullptr)){
+        _done = true;
+        break;
+      }
+    }
+    else{
+      if(_next_blob == _blobs.size()){
+        _done = true;
+        break;
+      }
+      info = _blobs[_next_blob];
+      std::string stored;
+      if(_next_blob < _stored.size()){
+        stored = std::move(_stored[_next_blob]);
+      }
+      ++_next_blob;
+      if(stored.empty()){
+        _input.seekg(info.offset);
+      }
+
+      // The blob may only hold wanted objects, in which case it is
+      // copied as is once decoding confirms that they all pass the id
+      // filter.
+      verify_raw = _raw_complete and (info.max_wanted == info.count());
+
+      if(!stored.empty()){
+        data = stored_blob_data(stored);
+        if(verify_raw){
+          raw = std::move(stored);
+        }
+      }
+      else{
+        blob_info read_info;
+        if(!read_blob("OSMData", read_info, data, verify_raw ? &raw : nullptr)
+           or (read_info.size != info.size)){
+          throw osmium::pbf_error("blob not found at recorded offset");
+        }
+      }
+    }
+
+    auto blob = std::make_shared<const std::string>(std::move(data));
+    auto kept = std::make_shared<std::string>(std::move(raw));
+    const auto read_types = _read_types;
+    const auto read_meta = _read_meta;
+    const bool node_locations = _node_locations;
+    const bool record_ranges = _all_blobs;
+    const auto id_filter = _id_filter;
+    _pending.push_back(osmium::thread::Pool::instance().submit([blob, kept, info, read_types, read_meta, node_locations, record_ranges, id_filter, verify_raw]{
+          std::string output;
+          osmium::io::detail::PBFPrimitiveBlockDecoder decoder(osmium::io::detail::decode_blob(*blob, output),
+                                                               read_types,
+                                                               read_meta);
+          pbf_blob result;
+          result.raw = std::move(*kept);
+          if(node_locations){
+            decoder.set_node_locations(result.nodes.ids, result.nodes.locations);
+          }
+          if(id_filter){
+            decoder.set_id_filter(id_filter);
+          }
+          result.buffer = decoder();
+          result.info = info;
+          if(verify_raw){
+            const std::size_t decoded = result.nodes.ids.size()
+              + result.buffer.select<osmium::OSMObject>().size();
+            if(decoded == info.count()){
+              result.buffer = osmium::memory::Buffer();
+            }
+            else{
+              result.raw.clear();
+            }
+          }
+          if(record_ranges){
+            for(auto id: result.nodes.ids){
+              result.info.range(osmium::item_type::node).extend(id);
+            }
+            for(const auto& object: result.buffer.select<osmium::OSMObject>()){
+              result.info.range(object.type()).extend(object.id());
+            }
+          }
+          return result;
+        }));
+  }
+}
+
+const osmium::io::Header& blob_reader::header() const{
+  return _header;
+}
+
+void blob_reader::set_id_filter(osmium::io::detail::PBFPrimitiveBlockDecoder::id_filter_type filter){
+  _id_filter = std::move(filter);
+}
+
+void blob_reader::keep_raw(bool keep){
+  _keep_raw = keep;
+}
+
+void blob_reader::set_stored(std::vector<std::string>&& stored){
+  _stored = std::move(stored);
+}
+
+bool blob_reader::read(pbf_blob& blob){
+  fill();
+  if(_pending.empty()){
+    return false;
+  }
+  blob = _pending.front().get();
+  _pending.pop_front();
+  fill();
+  return true;
+}
+
+blob_writer::blob_writer(const osmium::io::File& file,
+                         const osmium::io::Header& header):
+  _output(file.filename(), std::ios::binary | std::ios::trunc),
+  _format(file, _queue){
+  if(!_output){
+    throw osmium::io_error("Unable to open " + file.filename());
+  }
+  _format.write_header(header);
+}
+
+blob_writer::~blob_writer(){
+  try{
+    close();
+  }
+  catch(...){
+    // Ignore any exceptions because destructor must not throw.
+  }
+}
+
+void blob_writer::drain(std::size_t max_size){
+  while(_queue.size() > max_size){
+    std::future<std::string> data;
+    _queue.wait_and_pop(data);
+    const std::string blob = data.get();
+    _output.write(blob.data(), blob.size());
+  }
+  if(!_output){
+    throw osmium::io_error("Write failed");
+  }
+}
+
+void blob_writer::operator()(osmium::memory::Buffer&& buffer){
+  _format.write_buffer(std::move(buffer));
+  drain(max_queued_blobs());
+}
+
+void blob_writer::write_raw(std::string&& blob){
+  _format.flush();
+  osmium::io::detail::add_to_queue(_queue, std::move(blob));
+  drain(max_queued_blobs());
+}
+
+void blob_writer::close(){
+  if(_output.is_open()){
+    _format.write_end();
+    drain(0);
+    _output.close();
+  }
+}
@@ -0,0 +1,197 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef PBF_BLOBS_H
+#define PBF_BLOBS_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+#include <osmium/io/detail/pbf_decoder.hpp>
+#include <osmium/io/detail/pbf_output_format.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/io/file_format.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/types.hpp>
+#include "id_set.h"
+#include "node_checker.h"
+
+// Range of ids for one object type in a blob.
+struct id_range{
+  osmium::object_id_type first;
+  osmium::object_id_type last;
+  uint32_t count;
+
+  id_range();
+
+  void extend(osmium::object_id_type id);
+};
+
+// Position of a data blob in a PBF file, with the ids it holds.
+struct blob_info{
+  // Offset of the blob header size, and size up to the end of the
+  // blob.
+  uint64_t offset;
+  uint64_t size;
+
+  // Ranges for nodes, ways and relations.
+  std::array<id_range, 3> ranges;
+
+  // Upper bound on the number of wanted objects in the blob: wanted
+  // ids are counted when in the id range of the blob, whether the
+  // blob holds them or not, and once for each id set marking them.
+  uint32_t max_wanted;
+
+  blob_info();
+
+  id_range& range(osmium::item_type type);
+
+  const id_range& range(osmium::item_type type) const;
+
+  // Number of nodes, ways and relations in the blob.
+  uint32_t count() const;
+};
+
+// Whether file is an uncompressed PBF file that can be read blob by
+// blob.
+bool is_seekable_pbf(const osmium::io::File& file);
+
+// Increment max_wanted of blobs for each id of given type in ids
+// falling in their range. Ranges for each type have to be in
+// ascending order along blobs, as in sorted files.
+void mark_wanted(std::vector<blob_info>& blobs,
+                 osmium::item_type type,
+                 const id_set& ids);
+
+// Data blob read from a PBF file with its position and ids, either
+// decoded or kept as stored in the file.
+struct pbf_blob{
+  osmium::memory::Buffer buffer;
+
+  // Nodes if decoding node locations only.
+  node_locations nodes;
+
+  // Whole blob as stored in the file, including its header, if it is
+  // to be copied as is or kept for another pass.
+  std::string raw;
+
+  blob_info info;
+};
+
+// Read a PBF file blob by blob, data blobs being decoded on the
+// osmium thread pool ahead of consumption. Either all data blobs are
+// read in order, or only given blobs. Nodes can be decoded as ids and
+// locations only, skipping tags and metadata, and unwanted objects
+// can be skipped by the decoder.
+class blob_reader{
+private:
+  std::ifstream _input;
+  const osmium::osm_entity_bits::type _read_types;
+  const osmium::io::read_meta _read_meta;
+  const bool _node_locations;
+  osmium::io::detail::PBFPrimitiveBlockDecoder::id_filter_type _id_filter;
+  osmium::io::Header _header;
+
+  // Blobs to read if not all of them, and next one to decode.
+  bool _all_blobs;
+  std::vector<blob_info> _blobs;
+  std::size_t _next_blob;
+  bool _done;
+
+  // Whether blobs with all objects passing the id filter are
+  // returned as stored instead of decoded.
+  bool _raw_complete;
+
+  // Whether blobs read are also returned as stored.
+  bool _keep_raw;
+
+  // Blobs already in memory, as stored in the file.
+  std::vector<std::string> _stored;
+
+  std::deque<std::future<pbf_blob>> _pending;
+
+  // Read the blob at current position, return false at end of file.
+  // The whole blob is also copied to raw if not null.
+  bool read_blob(const char* expected_type,
+                 blob_info& info,
+                 std::string& data,
+                 std::string* raw = nullptr);
+
+  // Submit blobs to decode until enough are in flight.
+  void fill();
+
+public:
+  blob_reader(const std::string& file_name,
+              osmium::osm_entity_bits::type read_types,
+              osmium::io::read_meta read_meta,
+              bool node_locations);
+
+  // Read given blobs only. If raw_complete is true, blobs whose
+  // max_wanted matches their object count are returned as stored,
+  // with an empty buffer, when all their objects pass the id filter.
+  blob_reader(const std::string& file_name,
+              osmium::osm_entity_bits::type read_types,
+              osmium::io::read_meta read_meta,
+              const std::vector<blob_info>& blobs,
+              bool raw_complete);
+
+  ~blob_reader();
+
+  const osmium::io::Header& header() const;
+
+  // Only decode objects accepted by filter, to be set before the
+  // first read.
+  void set_id_filter(osmium::io::detail::PBFPrimitiveBlockDecoder::id_filter_type filter);
+
+  // Also return data blobs as stored in the file while keep is true,
+  // for blobs not read ahead yet.
+  void keep_raw(bool keep);
+
+  // Blobs kept from a previous read, in the order of blobs given to
+  // the constructor, empty ones being read from the file. To be set
+  // before the first read.
+  void set_stored(std::vector<std::string>&& stored);
+
+  // Get the next blob in file order, return false once all blobs are
+  // read.
+  bool read(pbf_blob& blob);
+};
+
+// Write a PBF file from buffers encoded with the osmium PBF output
+// format, in order with raw blobs copied from another PBF file.
+class blob_writer{
+private:
+  std::ofstream _output;
+  osmium::io::detail::future_string_queue_type _queue;
+  osmium::io::detail::PBFOutputFormat _format;
+
+  // Write encoded blobs until at most max_size are left in the queue.
+  void drain(std::size_t max_size);
+
+public:
+  blob_writer(const osmium::io::File& file, const osmium::io::Header& header);
+
+  ~blob_writer();
+
+  void operator()(osmium::memory::Buffer&& buffer);
+
+  // Write a raw blob after all objects written so far.
+  void write_raw(std::string&& blob);
+
+  void close();
+};
+
+#endif
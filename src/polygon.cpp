@@ -10,42 +10,31 @@ All rights reserved (see LICENSE).
 #include "polygon.h"
 
 polygon::polygon(const std::string& name,
-                 const rapidjson::Value& json_rings):
-  _name(name),
-  _outer_ring(json_rings[0])    // First ring as exterior ring.
-{
-  auto out_bbox = _outer_ring.bbox();
-
-  // Setting inner rings.
-  std::for_each(json_rings.Begin() + 1,
-                json_rings.End(),
-                [&](const auto& r){
-                  _inner_rings.emplace_back(r);
-                  auto in_bbox = _inner_rings.back().bbox();
-                  assert(out_bbox.contains(in_bbox.bottom_left())
-                         and out_bbox.contains(in_bbox.top_right()));
-                });
+                 const rapidjson::Value& json_rings){
+  _set.add_polygon(name, json_rings);
 }
 
 std::string polygon::get_name() const{
-  return _name;
+  return _set.name(0);
 }
 
 bool polygon::contains(const osmium::Location& loc) const{
-  bool contained = _outer_ring.contains(loc);
-  for(const auto& r: _inner_rings){
-    contained &= !r.contains(loc);
-    if(!contained){
-      break;
-    }
-  }
-  return contained;
+  return _set.contains(0, loc);
 }
 
 bool polygon::contains(const osmium::Node& node) const{
   return this->contains(node.location());
 }
 
+void polygon::contains_batch(const std::vector<osmium::Location>& locations,
+                             std::vector<bool>& contained) const{
+  _set.contains_batch(0, locations, contained);
+}
+
+box_position polygon::classify(const osmium::Box& box) const{
+  return _set.classify(0, box);
+}
+
 osmium::Box polygon::bbox() const{
-  return _outer_ring.bbox();
+  return _set.bbox(0);
 }
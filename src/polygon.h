@@ -15,13 +15,12 @@ All rights reserved (see LICENSE).
 #include <osmium/osm/box.hpp>
 #include <osmium/osm/node.hpp>
 #include "../include/rapidjson/document.h"
-#include "ring.h"
+#include "polygon_set.h"
 
+// Standalone polygon, stored as a set holding only this polygon.
 class polygon{
 private:
-  std::string _name;
-  ring _outer_ring;
-  std::vector<ring> _inner_rings;
+  polygon_set _set;
 
 public:
   polygon(const std::string& name,
@@ -33,6 +32,15 @@ public:
 
   bool contains(const osmium::Node& node) const;
 
+  // Set contained[i] to true for all locations[i] in the polygon,
+  // other values are left untouched so that results for several
+  // polygons can be merged.
+  void contains_batch(const std::vector<osmium::Location>& locations,
+                      std::vector<bool>& contained) const;
+
+  // Inclusion status shared by all locations in box.
+  box_position classify(const osmium::Box& box) const;
+
   osmium::Box bbox() const;
 };
 
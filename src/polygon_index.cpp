@@ -0,0 +1,339 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
+#include "box_grid.h"
+#include "cell_covering.h"
+#include "packed_rtree.h"
+#include "polygon_index.h"
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+// Rtree keyed on integer location coordinates, matching polygon
+// bounding boxes exactly.
+typedef bg::model::point<int32_t, 2, bg::cs::cartesian> point;
+typedef bg::model::box<point> box;
+typedef std::pair<box, uint32_t> value;
+
+// Allocator keeping track of the memory used by the Rtree nodes.
+template<class T>
+struct counting_allocator{
+  typedef T value_type;
+
+  std::size_t* _bytes;
+
+  counting_allocator(std::size_t* bytes):
+    _bytes(bytes){}
+
+  template<class U>
+  counting_allocator(const counting_allocator<U>& other):
+    _bytes(other._bytes){}
+
+  T* allocate(std::size_t n){
+    *_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, std::size_t n){
+    *_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template<class U>
+  bool operator==(const counting_allocator<U>& other) const{
+    return _bytes == other._bytes;
+  }
+
+  template<class U>
+  bool operator!=(const counting_allocator<U>& other) const{
+    return _bytes != other._bytes;
+  }
+};
+
+typedef bgi::rtree<value,
+                   bgi::rstar<16>,
+                   bgi::indexable<value>,
+                   bgi::equal_to<value>,
+                   counting_allocator<value>> rtree_t;
+
+polygon_index::polygon_index(const polygon_set& polygons):
+  _polygons(polygons){}
+
+polygon_index::~polygon_index(){}
+
+box_position polygon_index::classify_candidates(const osmium::Box& box,
+                                                std::vector<uint32_t>& ranks) const{
+  std::size_t size = 0;
+  for(auto rank: ranks){
+    switch(_polygons.classify(rank, box)){
+    case box_position::inside:
+      ranks.clear();
+      return box_position::inside;
+    case box_position::boundary:
+      ranks[size++] = rank;
+      break;
+    case box_position::outside:
+      break;
+    }
+  }
+  ranks.resize(size);
+  return ranks.empty() ? box_position::outside : box_position::boundary;
+}
+
+bool polygon_index::checks_locations() const{
+  return false;
+}
+
+bool polygon_index::contains(const osmium::Location& loc,
+                             const std::vector<uint32_t>& ranks) const{
+  for(auto rank: ranks){
+    if(_polygons.contains(rank, loc)){
+      return true;
+    }
+  }
+  return false;
+}
+
+// Rtree of polygon bounding boxes.
+class rtree_index : public polygon_index{
+private:
+  std::size_t _bytes;
+  rtree_t _rtree;
+
+public:
+  rtree_index(const polygon_set& polygons):
+    polygon_index(polygons),
+    _bytes(0),
+    _rtree(bgi::rstar<16>(),
+           bgi::indexable<value>(),
+           bgi::equal_to<value>(),
+           counting_allocator<value>(&_bytes)){
+    for(uint32_t i = 0; i < polygons.size(); ++i){
+      const auto& bl = polygons.bbox(i).bottom_left();
+      const auto& tr = polygons.bbox(i).top_right();
+      _rtree.insert(std::make_pair(box(point(bl.x(), bl.y()),
+                                       point(tr.x(), tr.y())),
+                                   i));
+    }
+  }
+
+  const char* name() const override{
+    return "rtree";
+  }
+
+  std::string description() const override{
+    return std::to_string(_rtree.size()) + " polygon bounding boxes";
+  }
+
+  std::size_t memory() const override{
+    return _bytes;
+  }
+
+  box_position classify(const osmium::Box& cell,
+                        std::vector<uint32_t>& ranks) const override{
+    const auto& bl = cell.bottom_left();
+    const auto& tr = cell.top_right();
+
+    // Classify polygons whose bbox intersects the cell while querying
+    // the Rtree, without storing query results. Once a polygon
+    // contains the whole cell, remaining polygons only go through
+    // bounding box tests.
+    box_position position = box_position::outside;
+    ranks.clear();
+    auto classify = [&](const value& v){
+      if(position == box_position::inside){
+        return false;
+      }
+      switch(_polygons.classify(v.second, cell)){
+      case box_position::inside:
+        position = box_position::inside;
+        ranks.clear();
+        break;
+      case box_position::boundary:
+        position = box_position::boundary;
+        ranks.push_back(v.second);
+        break;
+      case box_position::outside:
+        break;
+      }
+      return false;
+    };
+    _rtree.query(bgi::intersects(box(point(bl.x(), bl.y()),
+                                     point(tr.x(), tr.y())))
+                 and bgi::satisfies(classify),
+                 boost::make_function_output_iterator([](const value&){}));
+    std::sort(ranks.begin(), ranks.end());
+    return position;
+  }
+};
+
+// Uniform grid of polygon bounding boxes.
+class grid_index : public polygon_index{
+private:
+  box_grid _grid;
+
+  static box_grid make_grid(const polygon_set& polygons){
+    if(polygons.empty()){
+      return box_grid();
+    }
+    std::vector<osmium::Box> bboxes;
+    osmium::Box extent;
+    for(std::size_t p = 0; p < polygons.size(); ++p){
+      bboxes.push_back(polygons.bbox(p));
+      extent.extend(polygons.bbox(p));
+    }
+    return box_grid(extent, bboxes, 0, bboxes.size());
+  }
+
+public:
+  grid_index(const polygon_set& polygons):
+    polygon_index(polygons),
+    _grid(make_grid(polygons)){}
+
+  const char* name() const override{
+    return "grid";
+  }
+
+  std::string description() const override{
+    return std::to_string(_polygons.size()) + " polygon bounding boxes";
+  }
+
+  std::size_t memory() const override{
+    return _grid.memory();
+  }
+
+  box_position classify(const osmium::Box& cell,
+                        std::vector<uint32_t>& ranks) const override{
+    ranks.clear();
+    if(_grid.empty()){
+      return box_position::outside;
+    }
+    _grid.candidates(cell, ranks);
+    return classify_candidates(cell, ranks);
+  }
+};
+
+// Linear quadtree of cells, locations in boundary cells being
+// checked by the covering itself.
+class quadtree_index : public polygon_index{
+private:
+  cell_covering _covering;
+
+public:
+  quadtree_index(const polygon_set& polygons):
+    polygon_index(polygons),
+    _covering(polygons){}
+
+  const char* name() const override{
+    return "quadtree";
+  }
+
+  std::string description() const override{
+    return std::to_string(_covering.size()) + " cells, "
+      + std::to_string(_covering.interior_cells())
+      + " of them inside polygon(s)";
+  }
+
+  std::size_t memory() const override{
+    return _covering.memory();
+  }
+
+  box_position classify(const osmium::Box& cell,
+                        std::vector<uint32_t>& ranks) const override{
+    // Candidates are not needed to check locations.
+    ranks.clear();
+    return _covering.classify(cell);
+  }
+
+  bool checks_locations() const override{
+    return true;
+  }
+
+  bool contains(const osmium::Location& loc,
+                const std::vector<uint32_t>&) const override{
+    return _covering.contains(loc);
+  }
+};
+
+// Packed Rtree of polygon edge chunks.
+class packed_index : public polygon_index{
+private:
+  packed_rtree _rtree;
+
+public:
+  packed_index(const polygon_set& polygons):
+    polygon_index(polygons),
+    _rtree(polygons){}
+
+  const char* name() const override{
+    return "packed";
+  }
+
+  std::string description() const override{
+    return std::to_string(_rtree.size()) + " edge chunks";
+  }
+
+  std::size_t memory() const override{
+    return _rtree.memory();
+  }
+
+  box_position classify(const osmium::Box& cell,
+                        std::vector<uint32_t>& ranks) const override{
+    thread_local packed_rtree::windings_t windings;
+    const auto position = _rtree.classify(cell, ranks, windings);
+    if(position != box_position::boundary){
+      return position;
+    }
+    // Chunk boxes are coarse, check polygons near the cell.
+    return classify_candidates(cell, ranks);
+  }
+
+  bool checks_locations() const override{
+    return true;
+  }
+
+  // Winding numbers come from the chunks crossing the line through
+  // loc, whatever the size of the candidate polygons.
+  bool contains(const osmium::Location& loc,
+                const std::vector<uint32_t>&) const override{
+    thread_local packed_rtree::windings_t windings;
+    return _rtree.contains(loc, windings);
+  }
+};
+
+const std::vector<std::string>& index_names(){
+  static const std::vector<std::string> names({"rtree",
+                                               "grid",
+                                               "quadtree",
+                                               "packed"});
+  return names;
+}
+
+std::unique_ptr<polygon_index> make_index(const std::string& name,
+                                          const polygon_set& polygons){
+  if(name == "rtree"){
+    return std::make_unique<rtree_index>(polygons);
+  }
+  if(name == "grid"){
+    return std::make_unique<grid_index>(polygons);
+  }
+  if(name == "quadtree"){
+    return std::make_unique<quadtree_index>(polygons);
+  }
+  if(name == "packed"){
+    return std::make_unique<packed_index>(polygons);
+  }
+  return nullptr;
+}
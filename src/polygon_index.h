@@ -0,0 +1,71 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef POLYGON_INDEX_H
+#define POLYGON_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include "polygon_set.h"
+
+// Spatial index telling which polygons may contain locations in a
+// box. Available backends are an R-tree and a uniform grid of
+// polygon bounding boxes, a linear quadtree of cells and a packed
+// R-tree of polygon edges.
+class polygon_index{
+protected:
+  const polygon_set& _polygons;
+
+  // Keep in ranks the polygons whose boundary crosses box, return
+  // inside if one of them contains box.
+  box_position classify_candidates(const osmium::Box& box,
+                                   std::vector<uint32_t>& ranks) const;
+
+public:
+  polygon_index(const polygon_set& polygons);
+
+  virtual ~polygon_index();
+
+  virtual const char* name() const = 0;
+
+  // Short summary of the index content.
+  virtual std::string description() const = 0;
+
+  // Approximate heap memory used by the index, in bytes.
+  virtual std::size_t memory() const = 0;
+
+  // Inclusion status of box in the union of polygons. For boundary
+  // boxes, ranks holds the sorted polygons to check, unless the index
+  // checks locations itself.
+  virtual box_position classify(const osmium::Box& box,
+                                std::vector<uint32_t>& ranks) const = 0;
+
+  // Whether contains should be used for locations in boundary boxes
+  // rather than checking each candidate polygon.
+  virtual bool checks_locations() const;
+
+  // Inclusion of loc in the union of polygons, ranks being the
+  // candidates for a boundary box containing loc.
+  virtual bool contains(const osmium::Location& loc,
+                        const std::vector<uint32_t>& ranks) const;
+};
+
+// Names accepted by make_index.
+const std::vector<std::string>& index_names();
+
+// Build the index with given name, return nullptr for an unknown
+// name.
+std::unique_ptr<polygon_index> make_index(const std::string& name,
+                                          const polygon_set& polygons);
+
+#endif
@@ -0,0 +1,582 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include "polygon_set.h"
+#include "winding.h"
+
+// Rings with fewer edges are checked by walking all edges.
+constexpr std::size_t grid_min_edges = 16;
+
+// Rings with fewer edges use slabs for locations in crowded grid
+// cells.
+constexpr std::size_t locator_min_edges = 4096;
+
+// Polygons with fewer inner rings check all of them.
+constexpr std::size_t hole_grid_min_rings = 8;
+
+const char* shape_name(ring_shape shape){
+  switch(shape){
+  case ring_shape::rectangle:
+    return "rectangle";
+  case ring_shape::convex:
+    return "convex";
+  case ring_shape::monotone:
+    return "y-monotone";
+  case ring_shape::general:
+    break;
+  }
+  return "general";
+}
+
+polygon_set::polygon_set():
+  _ring_offsets(1, 0),
+  _polygon_offsets(1, 0){}
+
+void polygon_set::add_ring(const rapidjson::Value& json_ring){
+  // Set corners and bounding box.
+  const std::size_t first = _xs.size();
+  osmium::Box bbox;
+  std::for_each(json_ring.Begin(),
+                json_ring.End(),
+                [&](const auto& c){
+                  const osmium::Location corner(c[0].GetDouble(),
+                                                c[1].GetDouble());
+                  _xs.push_back(corner.x());
+                  _ys.push_back(corner.y());
+                  bbox.extend(corner);
+                });
+
+  // Stop if first and end corners are different.
+  if ((_xs[first] != _xs.back()) or (_ys[first] != _ys.back())){
+    std::cout << "Invalid ring, first and last coordinates do not match."
+              << std::endl;
+    exit(0);
+  }
+
+  _ring_offsets.push_back(_xs.size());
+  _ring_bboxes.push_back(bbox);
+  set_shape(_ring_bboxes.size() - 1);
+
+  const std::size_t size = _xs.size() - first;
+  _grids.emplace_back();
+  _locators.emplace_back();
+  _slabs.emplace_back();
+  if((_shapes.back() == ring_shape::general)
+     and (size - 1 >= grid_min_edges)){
+    _grids.back() = ring_grid(_xs.data() + first,
+                              _ys.data() + first,
+                              size,
+                              bbox);
+    if(_grids.back().crowded_cells() > 0){
+      if(size - 1 >= locator_min_edges){
+        // Left empty for self-intersecting rings.
+        _locators.back() = ring_locator(_xs.data() + first,
+                                        _ys.data() + first,
+                                        size,
+                                        bbox.bottom_left().x(),
+                                        bbox.top_right().x());
+      }
+      if(_locators.back().empty()){
+        _slabs.back() = slab_index(_xs.data() + first,
+                                   _ys.data() + first,
+                                   size);
+      }
+    }
+  }
+}
+
+void polygon_set::set_shape(std::size_t r){
+  const std::size_t first = _ring_offsets[r];
+  const std::size_t n = _ring_offsets[r + 1] - first - 1;
+  auto x = [&](std::size_t i){
+    return static_cast<int64_t>(_xs[first + i % n]);
+  };
+  auto y = [&](std::size_t i){
+    return static_cast<int64_t>(_ys[first + i % n]);
+  };
+  auto direction = [&](std::size_t i){
+    return (y(i) < y(i + 1)) ? 1 : ((y(i) > y(i + 1)) ? -1 : 0);
+  };
+  // Find the next edge going in direction d, starting from edge i.
+  auto next_edge = [&](std::size_t i, int d){
+    for(std::size_t k = 0; k < n; ++k){
+      if(direction(i + k) == d){
+        return (i + k) % n;
+      }
+    }
+    return n;
+  };
+
+  _shapes.push_back(ring_shape::general);
+  _bottoms.push_back(0);
+  _tops.push_back(0);
+  _orientations.push_back(0);
+  if(n < 3){
+    return;
+  }
+
+  // The ring is y-monotone if, after the lowest vertex, edges go up
+  // (or are horizontal) until the highest vertex, then go down
+  // until reaching the lowest vertex again.
+  const std::size_t down = next_edge(0, -1);
+  if(down == n){
+    return;
+  }
+  const std::size_t bottom = next_edge(down, 1);
+  const std::size_t top = next_edge(bottom, -1);
+  if(next_edge(top, 1) != bottom){
+    return;
+  }
+  _bottoms.back() = bottom;
+  _tops.back() = top;
+  _shapes.back() = ring_shape::monotone;
+
+  // Shortcuts below compute exact cross products, which is only
+  // valid if coordinate differences do not wrap around.
+  const auto& bbox = _ring_bboxes[r];
+  if(static_cast<int64_t>(bbox.top_right().x()) - bbox.bottom_left().x()
+     > std::numeric_limits<int32_t>::max()){
+    return;
+  }
+
+  bool is_rectangle = (n == 4);
+  for(std::size_t i = 0; is_rectangle and (i < n); ++i){
+    // Edges alternate between horizontal and vertical.
+    is_rectangle = ((x(i) == x(i + 1)) != (y(i) == y(i + 1)))
+      and ((x(i) == x(i + 1)) != (x(i + 1) == x(i + 2)));
+  }
+  if(is_rectangle){
+    _shapes.back() = ring_shape::rectangle;
+    return;
+  }
+
+  // A y-monotone ring always turning the same way is convex.
+  int8_t orientation = 0;
+  for(std::size_t i = 0; i < n; ++i){
+    const int64_t turn = (x(i + 1) - x(i)) * (y(i + 2) - y(i + 1))
+      - (y(i + 1) - y(i)) * (x(i + 2) - x(i + 1));
+    if((turn == 0)
+       or ((orientation != 0) and ((turn > 0) != (orientation > 0)))){
+      return;
+    }
+    orientation = (turn > 0) ? 1 : -1;
+  }
+  _orientations.back() = orientation;
+  _shapes.back() = ring_shape::convex;
+}
+
+void polygon_set::add_polygon(const std::string& name,
+                              const rapidjson::Value& json_rings){
+  _names.push_back(name);
+
+  // First ring as exterior ring.
+  std::for_each(json_rings.Begin(),
+                json_rings.End(),
+                [&](const auto& r){
+                  add_ring(r);
+                  assert(_ring_bboxes[_polygon_offsets.back()]
+                         .contains(_ring_bboxes.back().bottom_left())
+                         and _ring_bboxes[_polygon_offsets.back()]
+                         .contains(_ring_bboxes.back().top_right()));
+                });
+
+  const uint32_t outer_ring = _polygon_offsets.back();
+  _polygon_offsets.push_back(_ring_bboxes.size());
+
+  _hole_grids.emplace_back();
+  if(_ring_bboxes.size() - outer_ring - 1 >= hole_grid_min_rings){
+    _hole_grids.back() = box_grid(_ring_bboxes[outer_ring],
+                                  _ring_bboxes,
+                                  outer_ring + 1,
+                                  _ring_bboxes.size());
+  }
+}
+
+std::size_t polygon_set::size() const{
+  return _names.size();
+}
+
+bool polygon_set::empty() const{
+  return _names.empty();
+}
+
+const std::string& polygon_set::name(std::size_t p) const{
+  return _names[p];
+}
+
+const osmium::Box& polygon_set::bbox(std::size_t p) const{
+  return _ring_bboxes[_polygon_offsets[p]];
+}
+
+// Number of positions in [0, size) for which predicate holds,
+// assuming it holds for a prefix of the range.
+template<class Predicate>
+static std::size_t partition_point(std::size_t size, Predicate predicate){
+  std::size_t low = 0;
+  while(size > 0){
+    const std::size_t half = size / 2;
+    if(predicate(low + half)){
+      low += half + 1;
+      size -= half + 1;
+    }
+    else{
+      size = half;
+    }
+  }
+  return low;
+}
+
+int polygon_set::chain_winding_number(std::size_t r,
+                                      const osmium::Location& loc) const{
+  const std::size_t first = _ring_offsets[r];
+  const std::size_t n = _ring_offsets[r + 1] - first - 1;
+  const std::size_t up_edges = (_tops[r] + n - _bottoms[r]) % n;
+  auto up = [&](std::size_t k){
+    return first + (_bottoms[r] + k) % n;
+  };
+  auto down = [&](std::size_t k){
+    return first + (_tops[r] + k) % n;
+  };
+  auto location = [&](std::size_t i){
+    return osmium::Location(_xs[i], _ys[i]);
+  };
+
+  int wn = 0;
+
+  // Last vertex of the up chain not above loc starts the only edge
+  // that may go up across loc.y().
+  const std::size_t above_up
+    = partition_point(up_edges + 1,
+                      [&](std::size_t k){return _ys[up(k)] <= loc.y();});
+  if((0 < above_up) and (above_up <= up_edges)){
+    wn += edge_winding(loc, location(up(above_up - 1)), location(up(above_up)));
+  }
+
+  // First vertex of the down chain not above loc ends the only edge
+  // that may go down across loc.y().
+  const std::size_t above_down
+    = partition_point(n - up_edges + 1,
+                      [&](std::size_t k){return _ys[down(k)] > loc.y();});
+  if((0 < above_down) and (above_down <= n - up_edges)){
+    wn += edge_winding(loc,
+                       location(down(above_down - 1)),
+                       location(down(above_down)));
+  }
+
+  return wn;
+}
+
+int polygon_set::convex_position(std::size_t r,
+                                 const osmium::Location& loc) const{
+  const std::size_t first = _ring_offsets[r];
+  const std::size_t n = _ring_offsets[r + 1] - first - 1;
+  const int64_t orientation = _orientations[r];
+
+  // Orientation-adjusted position of loc relative to the line from
+  // vertex i to vertex j.
+  auto side = [&](std::size_t i, std::size_t j){
+    const int64_t x_i = _xs[first + i];
+    const int64_t y_i = _ys[first + i];
+    return orientation
+      * ((_xs[first + j] - x_i) * (loc.y() - y_i)
+         - (_ys[first + j] - y_i) * (loc.x() - x_i));
+  };
+
+  // Find the fan wedge from vertex 0 containing loc.
+  const int64_t first_side = side(0, 1);
+  const int64_t last_side = side(0, n - 1);
+  if((first_side < 0) or (last_side > 0)){
+    return 0;
+  }
+  if((first_side == 0) or (last_side == 0)){
+    return -1;
+  }
+  std::size_t low = 1;
+  std::size_t high = n - 1;
+  while(high - low > 1){
+    const std::size_t middle = (low + high) / 2;
+    const int64_t middle_side = side(0, middle);
+    if(middle_side == 0){
+      return -1;
+    }
+    if(middle_side > 0){
+      low = middle;
+    }
+    else{
+      high = middle;
+    }
+  }
+
+  const int64_t edge_side = side(low, high);
+  if(edge_side == 0){
+    return -1;
+  }
+  return (edge_side > 0) ? 1 : 0;
+}
+
+std::size_t polygon_set::rings_number(std::size_t p) const{
+  return _polygon_offsets[p + 1] - _polygon_offsets[p];
+}
+
+ring_shape polygon_set::shape(std::size_t p, std::size_t ring) const{
+  return _shapes[_polygon_offsets[p] + ring];
+}
+
+std::size_t polygon_set::ring_size(std::size_t p, std::size_t ring) const{
+  const std::size_t r = _polygon_offsets[p] + ring;
+  return _ring_offsets[r + 1] - _ring_offsets[r];
+}
+
+const int32_t* polygon_set::ring_xs(std::size_t p, std::size_t ring) const{
+  return _xs.data() + _ring_offsets[_polygon_offsets[p] + ring];
+}
+
+const int32_t* polygon_set::ring_ys(std::size_t p, std::size_t ring) const{
+  return _ys.data() + _ring_offsets[_polygon_offsets[p] + ring];
+}
+
+const osmium::Box& polygon_set::ring_bbox(std::size_t p,
+                                          std::size_t ring) const{
+  return _ring_bboxes[_polygon_offsets[p] + ring];
+}
+
+bool polygon_set::is_in_ring(std::size_t r, const osmium::Location& loc) const{
+  switch(_shapes[r]){
+  case ring_shape::rectangle:
+    // Right and top sides are outside, just like with the winding
+    // number.
+    return (loc.x() < _ring_bboxes[r].top_right().x())
+      and (loc.y() < _ring_bboxes[r].top_right().y());
+  case ring_shape::convex:{
+    const int position = convex_position(r, loc);
+    if(position >= 0){
+      return position == 1;
+    }
+    // Convex rings are also y-monotone.
+    return chain_winding_number(r, loc) != 0;
+  }
+  case ring_shape::monotone:
+    return chain_winding_number(r, loc) != 0;
+  case ring_shape::general:
+    break;
+  }
+
+  if(!_grids[r].empty()){
+    const int wn = _grids[r].winding_number(loc);
+    if(wn != ring_grid::crowded_cell){
+      return wn != 0;
+    }
+    if(!_locators[r].empty()){
+      return _locators[r].winding_number(loc) != 0;
+    }
+    // Only visit edges spanning loc.y() in crowded cells.
+    return _slabs[r].winding_number(loc) != 0;
+  }
+
+  // Based on the winding number method, see
+  // http://geomalgorithms.com/a03-_inclusion.html. Edges go from
+  // corner i to corner i + 1.
+  const std::size_t first = _ring_offsets[r];
+  const std::size_t edges_number = _ring_offsets[r + 1] - first - 1;
+  const int wn = winding_number(_xs.data() + first,
+                                _ys.data() + first,
+                                _xs.data() + first + 1,
+                                _ys.data() + first + 1,
+                                edges_number,
+                                loc.x(),
+                                loc.y());
+  return (wn != 0);
+}
+
+bool polygon_set::ring_contains(std::size_t r,
+                                const osmium::Location& loc) const{
+  // First checking with the bounding box to quickly discard most
+  // outsiders.
+  bool contained = _ring_bboxes[r].contains(loc);
+  if(contained){
+    contained &= this->is_in_ring(r, loc);
+  }
+  return contained;
+}
+
+box_position polygon_set::classify_ring(std::size_t r,
+                                        const osmium::Box& box) const{
+  const auto& bl = _ring_bboxes[r].bottom_left();
+  const auto& tr = _ring_bboxes[r].top_right();
+  if((box.top_right().x() < bl.x()) or (box.bottom_left().x() > tr.x())
+     or (box.top_right().y() < bl.y()) or (box.bottom_left().y() > tr.y())){
+    return box_position::outside;
+  }
+
+  // Only the part of box within the bounding box can be inside.
+  const osmium::Box clipped(osmium::Location(std::max(box.bottom_left().x(), bl.x()),
+                                             std::max(box.bottom_left().y(), bl.y())),
+                            osmium::Location(std::min(box.top_right().x(), tr.x()),
+                                             std::min(box.top_right().y(), tr.y())));
+  const bool within_bbox = (clipped == box);
+
+  box_position position;
+  if(!_grids[r].empty()){
+    position = _grids[r].classify(clipped);
+  }
+  else{
+    // The winding number can only change within the box if an edge
+    // bounding box overlaps it.
+    const auto& c_bl = clipped.bottom_left();
+    const auto& c_tr = clipped.top_right();
+    auto overlaps = [&](std::size_t i, std::size_t j){
+      return (std::max(_xs[i], _xs[j]) >= c_bl.x())
+        and (std::min(_xs[i], _xs[j]) <= c_tr.x())
+        and (std::max(_ys[i], _ys[j]) >= c_bl.y())
+        and (std::min(_ys[i], _ys[j]) <= c_tr.y());
+    };
+
+    const std::size_t first = _ring_offsets[r];
+    const std::size_t n = _ring_offsets[r + 1] - first - 1;
+    if(_shapes[r] == ring_shape::general){
+      for(std::size_t i = first; i < first + n; ++i){
+        if(overlaps(i, i + 1)){
+          return box_position::boundary;
+        }
+      }
+    }
+    else{
+      // Only check chain edges whose y range overlaps the box.
+      const std::size_t up_edges = (_tops[r] + n - _bottoms[r]) % n;
+      auto up = [&](std::size_t k){
+        return first + (_bottoms[r] + k) % n;
+      };
+      auto down = [&](std::size_t k){
+        return first + (_tops[r] + k) % n;
+      };
+      for(std::size_t k = partition_point(up_edges,
+                                          [&](std::size_t e){
+                                            return _ys[up(e + 1)] < c_bl.y();
+                                          });
+          (k < up_edges) and (_ys[up(k)] <= c_tr.y());
+          ++k){
+        if(overlaps(up(k), up(k + 1))){
+          return box_position::boundary;
+        }
+      }
+      for(std::size_t k = partition_point(n - up_edges,
+                                          [&](std::size_t e){
+                                            return _ys[down(e + 1)] > c_tr.y();
+                                          });
+          (k < n - up_edges) and (_ys[down(k)] >= c_bl.y());
+          ++k){
+        if(overlaps(down(k), down(k + 1))){
+          return box_position::boundary;
+        }
+      }
+    }
+    position = this->is_in_ring(r, c_bl) ?
+      box_position::inside : box_position::outside;
+  }
+
+  if((position == box_position::inside) and !within_bbox){
+    return box_position::boundary;
+  }
+  return position;
+}
+
+bool polygon_set::contains(std::size_t p, const osmium::Location& loc) const{
+  const std::size_t outer_ring = _polygon_offsets[p];
+  bool contained = ring_contains(outer_ring, loc);
+  if(contained and !_hole_grids[p].empty()){
+    // Only check holes whose bounding box may contain loc.
+    const auto holes = _hole_grids[p].candidates(loc);
+    for(auto r = holes.first; contained and (r != holes.second); ++r){
+      contained &= !ring_contains(*r, loc);
+    }
+    return contained;
+  }
+  for(std::size_t r = outer_ring + 1;
+      contained and (r < _polygon_offsets[p + 1]);
+      ++r){
+    contained &= !ring_contains(r, loc);
+  }
+  return contained;
+}
+
+void polygon_set::contains_batch(std::size_t p,
+                                 const std::vector<osmium::Location>& locations,
+                                 std::vector<bool>& contained) const{
+  // Check the whole batch one ring after the other to keep ring data
+  // in cache.
+  const std::size_t outer_ring = _polygon_offsets[p];
+  std::vector<bool> in_polygon(locations.size());
+  for(std::size_t i = 0; i < locations.size(); ++i){
+    in_polygon[i] = ring_contains(outer_ring, locations[i]);
+  }
+  if(!_hole_grids[p].empty()){
+    for(std::size_t i = 0; i < locations.size(); ++i){
+      if(!in_polygon[i]){
+        continue;
+      }
+      const auto holes = _hole_grids[p].candidates(locations[i]);
+      for(auto r = holes.first; r != holes.second; ++r){
+        if(ring_contains(*r, locations[i])){
+          in_polygon[i] = false;
+          break;
+        }
+      }
+    }
+  }
+  else{
+    for(std::size_t r = outer_ring + 1; r < _polygon_offsets[p + 1]; ++r){
+      for(std::size_t i = 0; i < locations.size(); ++i){
+        if(in_polygon[i] and ring_contains(r, locations[i])){
+          in_polygon[i] = false;
+        }
+      }
+    }
+  }
+
+  for(std::size_t i = 0; i < locations.size(); ++i){
+    if(in_polygon[i]){
+      contained[i] = true;
+    }
+  }
+}
+
+box_position polygon_set::classify(std::size_t p,
+                                   const osmium::Box& box) const{
+  const std::size_t outer_ring = _polygon_offsets[p];
+  box_position position = classify_ring(outer_ring, box);
+  if(position == box_position::outside){
+    return position;
+  }
+  std::vector<uint32_t> holes;
+  if(!_hole_grids[p].empty()){
+    _hole_grids[p].candidates(box, holes);
+  }
+  else{
+    for(uint32_t r = outer_ring + 1; r < _polygon_offsets[p + 1]; ++r){
+      holes.push_back(r);
+    }
+  }
+  for(auto r: holes){
+    switch(classify_ring(r, box)){
+    case box_position::inside:
+      // Box is in a hole.
+      return box_position::outside;
+    case box_position::boundary:
+      position = box_position::boundary;
+      break;
+    case box_position::outside:
+      break;
+    }
+  }
+  return position;
+}
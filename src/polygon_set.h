@@ -0,0 +1,135 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef POLYGON_SET_H
+#define POLYGON_SET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include "../include/rapidjson/document.h"
+#include "box_grid.h"
+#include "ring_grid.h"
+#include "ring_locator.h"
+#include "slab_index.h"
+
+// Ring shapes with a specific inclusion check. Rectangles are
+// axis-aligned, convex rings and y-monotone rings are made of two
+// chains of edges with monotone y values between their lowest and
+// highest vertices.
+enum class ring_shape{rectangle, convex, monotone, general};
+
+const char* shape_name(ring_shape shape);
+
+// Polygons stored in flat arrays. Vertices of all rings share the
+// same coordinate arrays, with offset tables delimiting rings and
+// the rings of each polygon, outer ring first.
+class polygon_set{
+private:
+  std::vector<std::string> _names;
+
+  // Vertices of ring r are in [_ring_offsets[r], _ring_offsets[r +
+  // 1]), the last one being equal to the first.
+  std::vector<int32_t> _xs;
+  std::vector<int32_t> _ys;
+  std::vector<uint32_t> _ring_offsets;
+  std::vector<osmium::Box> _ring_bboxes;
+
+  // Rings of polygon p are in [_polygon_offsets[p],
+  // _polygon_offsets[p + 1]).
+  std::vector<uint32_t> _polygon_offsets;
+
+  // Inner rings lookup for polygons with many holes, left empty for
+  // others.
+  std::vector<box_grid> _hole_grids;
+
+  // Shape of each ring. For all but general rings, the chain going
+  // up starts at vertex _bottoms[r] and ends at vertex _tops[r],
+  // relative to the first ring vertex. The other chain goes down from
+  // _tops[r] to _bottoms[r]. Convex rings also store their
+  // orientation, 1 for counter-clockwise and -1 for clockwise.
+  std::vector<ring_shape> _shapes;
+  std::vector<uint32_t> _bottoms;
+  std::vector<uint32_t> _tops;
+  std::vector<int8_t> _orientations;
+
+  // Lookup structures for large general rings, left empty for
+  // others. Locations in crowded grid cells are checked with a
+  // locator for huge rings, with slabs otherwise.
+  std::vector<ring_grid> _grids;
+  std::vector<ring_locator> _locators;
+  std::vector<slab_index> _slabs;
+
+  void add_ring(const rapidjson::Value& json_ring);
+
+  void set_shape(std::size_t r);
+
+  // Sum of the winding number contributions of the only edges of
+  // each chain that can cross the horizontal line through loc.
+  int chain_winding_number(std::size_t r, const osmium::Location& loc) const;
+
+  // Return 1 (resp. 0) if loc is strictly inside (resp. outside)
+  // convex ring r, -1 if loc is aligned with the edge or fan
+  // diagonal used to decide.
+  int convex_position(std::size_t r, const osmium::Location& loc) const;
+
+  // Location has to be in the bounding box of ring r.
+  bool is_in_ring(std::size_t r, const osmium::Location& loc) const;
+
+  bool ring_contains(std::size_t r, const osmium::Location& loc) const;
+
+  box_position classify_ring(std::size_t r, const osmium::Box& box) const;
+
+public:
+  polygon_set();
+
+  // Append a polygon from its geojson coordinates array, the first
+  // ring being the exterior ring.
+  void add_polygon(const std::string& name,
+                   const rapidjson::Value& json_rings);
+
+  std::size_t size() const;
+
+  bool empty() const;
+
+  const std::string& name(std::size_t p) const;
+
+  const osmium::Box& bbox(std::size_t p) const;
+
+  // Number of rings of polygon p, the outer ring being ring 0.
+  std::size_t rings_number(std::size_t p) const;
+
+  ring_shape shape(std::size_t p, std::size_t ring) const;
+
+  // Vertices of a ring of polygon p, the last one being equal to the
+  // first.
+  std::size_t ring_size(std::size_t p, std::size_t ring) const;
+
+  const int32_t* ring_xs(std::size_t p, std::size_t ring) const;
+
+  const int32_t* ring_ys(std::size_t p, std::size_t ring) const;
+
+  const osmium::Box& ring_bbox(std::size_t p, std::size_t ring) const;
+
+  bool contains(std::size_t p, const osmium::Location& loc) const;
+
+  // Set contained[i] to true for all locations[i] in polygon p, other
+  // values are left untouched so that results for several polygons
+  // can be merged.
+  void contains_batch(std::size_t p,
+                      const std::vector<osmium::Location>& locations,
+                      std::vector<bool>& contained) const;
+
+  // Inclusion status in polygon p shared by all locations in box.
+  box_position classify(std::size_t p, const osmium::Box& box) const;
+};
+
+#endif
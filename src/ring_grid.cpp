@@ -0,0 +1,234 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "ring_grid.h"
+
+// Maximum number of cells along each side of the grid.
+constexpr uint32_t max_grid_side = 512;
+
+// Boundary cells overlapped by more edges are flagged as crowded.
+constexpr std::size_t max_cell_edges = 64;
+
+constexpr int ring_grid::crowded_cell;
+
+ring_grid::ring_grid():
+  _min_x(0),
+  _min_y(0),
+  _cell_width(1),
+  _cell_height(1),
+  _columns(0),
+  _rows(0),
+  _crowded_cells(0){}
+
+ring_grid::ring_grid(const int32_t* xs,
+                     const int32_t* ys,
+                     std::size_t size,
+                     const osmium::Box& bbox):
+  _min_x(bbox.bottom_left().x()),
+  _min_y(bbox.bottom_left().y()),
+  _crowded_cells(0){
+  const std::size_t edges_number = size - 1;
+
+  // Roughly four cells per edge, so that most cells are crossed by
+  // no edge.
+  const uint32_t side
+    = std::min(max_grid_side,
+               2 * static_cast<uint32_t>(std::ceil(std::sqrt(edges_number))));
+
+  const int64_t width = static_cast<int64_t>(bbox.top_right().x()) - _min_x;
+  const int64_t height = static_cast<int64_t>(bbox.top_right().y()) - _min_y;
+  _cell_width = width / side + 1;
+  _cell_height = height / side + 1;
+  _columns = static_cast<uint32_t>(width / _cell_width + 1);
+  _rows = static_cast<uint32_t>(height / _cell_height + 1);
+
+  // Dispatch edges and vertices to the rows they span.
+  std::vector<std::vector<uint32_t>> row_edges(_rows);
+  std::vector<std::vector<uint32_t>> row_vertices(_rows);
+  for(uint32_t i = 0; i < edges_number; ++i){
+    for(uint32_t r = row(std::min(ys[i], ys[i + 1]));
+        r <= row(std::max(ys[i], ys[i + 1]));
+        ++r){
+      row_edges[r].push_back(i);
+    }
+    row_vertices[row(ys[i])].push_back(i);
+  }
+
+  // Conservative range of columns overlapped by the part of edge i
+  // that lies in the band of row r.
+  auto band_columns = [&](uint32_t i, uint32_t r){
+    int64_t x_min = std::min(xs[i], xs[i + 1]);
+    int64_t x_max = std::max(xs[i], xs[i + 1]);
+    if(ys[i] != ys[i + 1]){
+      const int64_t band_bottom = _min_y + r * _cell_height;
+      const int64_t band_low = std::max<int64_t>(std::min(ys[i], ys[i + 1]),
+                                                 band_bottom);
+      const int64_t band_high = std::min<int64_t>(std::max(ys[i], ys[i + 1]),
+                                                  band_bottom + _cell_height - 1);
+      const double slope = static_cast<double>(xs[i + 1] - xs[i])
+        / static_cast<double>(ys[i + 1] - ys[i]);
+      const double x_low = xs[i] + slope * (band_low - ys[i]);
+      const double x_high = xs[i] + slope * (band_high - ys[i]);
+      // Widen by one unit to stay on the safe side of rounding.
+      x_min = std::max(x_min,
+                       static_cast<int64_t>(std::floor(std::min(x_low, x_high))) - 1);
+      x_max = std::min(x_max,
+                       static_cast<int64_t>(std::ceil(std::max(x_low, x_high))) + 1);
+    }
+    return std::make_pair(column(static_cast<int32_t>(x_min)),
+                          column(static_cast<int32_t>(x_max)));
+  };
+
+  std::vector<uint32_t> first_column(edges_number);
+  std::vector<std::vector<uint32_t>> cell_edges(_columns);
+  std::vector<std::vector<std::pair<int32_t, int32_t>>> cell_steps(_columns);
+  std::vector<int32_t> winding_changes(_columns + 1);
+
+  _windings.reserve(_columns * _rows);
+  _edge_offsets.reserve(_columns * _rows + 1);
+  _step_offsets.reserve(_columns * _rows + 1);
+  _edge_offsets.push_back(0);
+  _step_offsets.push_back(0);
+
+  for(uint32_t r = 0; r < _rows; ++r){
+    const int64_t band_bottom = _min_y + r * _cell_height;
+    std::fill(winding_changes.begin(), winding_changes.end(), 0);
+
+    for(auto i: row_edges[r]){
+      const auto columns = band_columns(i, r);
+      first_column[i] = columns.first;
+      for(uint32_t c = columns.first; c <= columns.second; ++c){
+        cell_edges[c].push_back(i);
+      }
+
+      // For cells strictly on the left of the edge, its contribution
+      // only depends on y. Account for it at the bottom of the band.
+      if((std::min(ys[i], ys[i + 1]) <= band_bottom)
+         and (band_bottom < std::max(ys[i], ys[i + 1]))){
+        const int32_t direction = (ys[i] < ys[i + 1]) ? 1 : -1;
+        winding_changes[0] += direction;
+        winding_changes[columns.first] -= direction;
+      }
+    }
+
+    // Higher in the band, contributions from edges on the right only
+    // change at vertices joining an edge on the right of the cell
+    // and an edge overlapping it.
+    for(auto v: row_vertices[r]){
+      const int32_t y = ys[v];
+      if(y == band_bottom){
+        continue;
+      }
+      const uint32_t in_first = first_column[(v == 0) ? edges_number - 1 : v - 1];
+      const uint32_t out_first = first_column[v];
+      for(uint32_t c = std::min(in_first, out_first);
+          c < std::max(in_first, out_first);
+          ++c){
+        cell_steps[c].emplace_back(y, (in_first < out_first) ? 1 : -1);
+      }
+    }
+
+    int32_t winding = 0;
+    for(uint32_t c = 0; c < _columns; ++c){
+      winding += winding_changes[c];
+
+      if(cell_edges[c].size() > max_cell_edges){
+        ++_crowded_cells;
+        _windings.push_back(crowded_cell);
+        _edge_offsets.push_back(_edges.size());
+        _step_offsets.push_back(_steps.size());
+        cell_edges[c].clear();
+        cell_steps[c].clear();
+        continue;
+      }
+
+      _windings.push_back(winding);
+
+      for(auto i: cell_edges[c]){
+        _edges.push_back(xs[i], ys[i], xs[i + 1], ys[i + 1]);
+      }
+      _edge_offsets.push_back(_edges.size());
+      cell_edges[c].clear();
+
+      // Merge steps with the same y value and drop those cancelling
+      // out.
+      auto& steps = cell_steps[c];
+      std::sort(steps.begin(), steps.end());
+      for(std::size_t s = 0; s < steps.size(); ){
+        std::pair<int32_t, int32_t> step(steps[s].first, 0);
+        for(; (s < steps.size()) and (steps[s].first == step.first); ++s){
+          step.second += steps[s].second;
+        }
+        if(step.second != 0){
+          _steps.push_back(step);
+        }
+      }
+      _step_offsets.push_back(_steps.size());
+      steps.clear();
+    }
+  }
+}
+
+uint32_t ring_grid::column(int32_t x) const{
+  return static_cast<uint32_t>((static_cast<int64_t>(x) - _min_x) / _cell_width);
+}
+
+uint32_t ring_grid::row(int32_t y) const{
+  return static_cast<uint32_t>((static_cast<int64_t>(y) - _min_y) / _cell_height);
+}
+
+bool ring_grid::empty() const{
+  return _windings.empty();
+}
+
+std::size_t ring_grid::crowded_cells() const{
+  return _crowded_cells;
+}
+
+int ring_grid::winding_number(const osmium::Location& loc) const{
+  const std::size_t cell = row(loc.y()) * _columns + column(loc.x());
+
+  int wn = _windings[cell];
+  if(wn == crowded_cell){
+    return wn;
+  }
+
+  // Only boundary cells have steps and edges to check.
+  for(std::size_t s = _step_offsets[cell]; s < _step_offsets[cell + 1]; ++s){
+    if(_steps[s].first <= loc.y()){
+      wn += _steps[s].second;
+    }
+  }
+  return wn + _edges.winding_number(_edge_offsets[cell],
+                                    _edge_offsets[cell + 1],
+                                    loc);
+}
+
+box_position ring_grid::classify(const osmium::Box& box) const{
+  const uint32_t first_column = column(box.bottom_left().x());
+  const uint32_t last_column = column(box.top_right().x());
+  const uint32_t first_row = row(box.bottom_left().y());
+  const uint32_t last_row = row(box.top_right().y());
+
+  for(uint32_t r = first_row; r <= last_row; ++r){
+    for(uint32_t c = first_column; c <= last_column; ++c){
+      const std::size_t cell = r * _columns + c;
+      if((_windings[cell] == crowded_cell)
+         or (_edge_offsets[cell] != _edge_offsets[cell + 1])){
+        return box_position::boundary;
+      }
+    }
+  }
+
+  // Cells with no edge have no steps either.
+  return (_windings[first_row * _columns + first_column] != 0) ?
+    box_position::inside : box_position::outside;
+}
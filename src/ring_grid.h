@@ -0,0 +1,80 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef RING_GRID_H
+#define RING_GRID_H
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <osmium/osm/box.hpp>
+#include <osmium/osm/location.hpp>
+#include "winding.h"
+
+// Uniform grid over the bounding box of a ring. Each cell stores the
+// winding number contribution of the edges lying entirely on its
+// right, so that cells crossed by no edge are classified as fully
+// inside or fully outside. Boundary cells keep the few edges
+// overlapping them and the y values where the contribution from the
+// right changes within the cell. Cells overlapped by too many edges
+// are left for the caller to check another way.
+class ring_grid{
+private:
+  int32_t _min_x;
+  int32_t _min_y;
+  int64_t _cell_width;
+  int64_t _cell_height;
+  uint32_t _columns;
+  uint32_t _rows;
+  std::size_t _crowded_cells;
+
+  // Winding number at the bottom of each cell for edges on its
+  // right.
+  std::vector<int32_t> _windings;
+
+  // Edges overlapping each cell.
+  std::vector<uint32_t> _edge_offsets;
+  edge_arrays _edges;
+
+  // (y, increment) pairs to apply to the winding number for points
+  // with y greater or equal.
+  std::vector<uint32_t> _step_offsets;
+  std::vector<std::pair<int32_t, int32_t>> _steps;
+
+  uint32_t column(int32_t x) const;
+
+  uint32_t row(int32_t y) const;
+
+public:
+  static constexpr int crowded_cell = std::numeric_limits<int32_t>::min();
+
+  ring_grid();
+
+  // Ring with size vertices, the last one being equal to the first.
+  ring_grid(const int32_t* xs,
+            const int32_t* ys,
+            std::size_t size,
+            const osmium::Box& bbox);
+
+  bool empty() const;
+
+  std::size_t crowded_cells() const;
+
+  // Location has to be in the bounding box used to build the grid.
+  // Return crowded_cell if the location falls in a crowded cell.
+  int winding_number(const osmium::Location& loc) const;
+
+  // Box has to be in the bounding box used to build the grid. Cells
+  // overlapped by the box are either all free of edges, giving the
+  // same status to all locations, or the box is on the boundary.
+  box_position classify(const osmium::Box& box) const;
+};
+
+#endif
@@ -0,0 +1,235 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include "ring_locator.h"
+
+// Products of coordinate differences need up to 100 bits when
+// comparing edges.
+__extension__ typedef __int128 int128_t;
+
+// Call f for the canonical nodes of the segment tree covering leaves
+// in [first, last), node k spanning leaves in [low, high).
+template<class F>
+static void for_each_node(std::size_t k,
+                          std::size_t low,
+                          std::size_t high,
+                          std::size_t first,
+                          std::size_t last,
+                          F& f){
+  if((last <= low) or (high <= first)){
+    return;
+  }
+  if((first <= low) and (high <= last)){
+    f(k);
+    return;
+  }
+  const std::size_t middle = (low + high) / 2;
+  for_each_node(2 * k, low, middle, first, last, f);
+  for_each_node(2 * k + 1, middle, high, first, last, f);
+}
+
+ring_locator::ring_locator():
+  _leaves(0){}
+
+ring_locator::ring_locator(const int32_t* xs,
+                           const int32_t* ys,
+                           std::size_t size,
+                           int32_t min_x,
+                           int32_t max_x):
+  _leaves(0){
+  // Ordering edges relies on check_left giving the exact cross
+  // product.
+  if(static_cast<int64_t>(max_x) - min_x > std::numeric_limits<int32_t>::max()){
+    return;
+  }
+
+  const std::size_t edges_number = size - 1;
+  std::vector<int32_t> values(ys, ys + edges_number);
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  if(values.size() < 2){
+    return;
+  }
+  const std::size_t leaves = values.size() - 1;
+
+  auto leaf = [&](int32_t y){
+    return static_cast<std::size_t>(std::lower_bound(values.begin(),
+                                                     values.end(),
+                                                     y)
+                                    - values.begin());
+  };
+
+  // Counting pass then filling pass to store edge lists
+  // contiguously. Horizontal edges never contribute.
+  std::vector<uint32_t> offsets(4 * leaves + 1, 0);
+  for(std::size_t i = 0; i < edges_number; ++i){
+    if(ys[i] == ys[i + 1]){
+      continue;
+    }
+    auto count = [&](std::size_t k){
+      ++offsets[k + 1];
+    };
+    for_each_node(1,
+                  0,
+                  leaves,
+                  leaf(std::min(ys[i], ys[i + 1])),
+                  leaf(std::max(ys[i], ys[i + 1])),
+                  count);
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<uint32_t> positions(offsets.begin(), offsets.end() - 1);
+  std::vector<uint32_t> node_edges(offsets.back());
+  for(uint32_t i = 0; i < edges_number; ++i){
+    if(ys[i] == ys[i + 1]){
+      continue;
+    }
+    auto fill = [&](std::size_t k){
+      node_edges[positions[k]++] = i;
+    };
+    for_each_node(1,
+                  0,
+                  leaves,
+                  leaf(std::min(ys[i], ys[i + 1])),
+                  leaf(std::max(ys[i], ys[i + 1])),
+                  fill);
+  }
+
+  // Twice the x value of edge i at y = twice_y / 2, multiplied by
+  // the edge height.
+  auto scaled_x = [&](uint32_t i, int64_t twice_y){
+    const bool up = (ys[i] < ys[i + 1]);
+    const int64_t low_x = up ? xs[i] : xs[i + 1];
+    const int64_t low_y = up ? ys[i] : ys[i + 1];
+    const int64_t dx = (up ? xs[i + 1] : xs[i]) - low_x;
+    const int64_t dy = std::abs(static_cast<int64_t>(ys[i + 1]) - ys[i]);
+    return static_cast<int128_t>(2 * low_x) * dy
+      + static_cast<int128_t>(twice_y - 2 * low_y) * dx;
+  };
+  auto height = [&](uint32_t i){
+    return static_cast<int128_t>(std::abs(static_cast<int64_t>(ys[i + 1]) - ys[i]));
+  };
+  auto west_of = [&](uint32_t i, uint32_t j, int64_t twice_y){
+    return scaled_x(i, twice_y) * height(j) < scaled_x(j, twice_y) * height(i);
+  };
+
+  // Sort edges of each node from west to east in the middle of the
+  // node range, then check that they do not cross at range bounds.
+  std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> nodes;
+  nodes.emplace_back(1, 0, leaves);
+  while(!nodes.empty()){
+    std::size_t k;
+    std::size_t low;
+    std::size_t high;
+    std::tie(k, low, high) = nodes.back();
+    nodes.pop_back();
+
+    const int64_t bottom = values[low];
+    const int64_t top = values[high];
+    const auto first = node_edges.begin() + offsets[k];
+    const auto last = node_edges.begin() + offsets[k + 1];
+    std::sort(first,
+              last,
+              [&](uint32_t i, uint32_t j){
+                return west_of(i, j, bottom + top);
+              });
+    for(auto e = first; (e != last) and (e + 1 != last); ++e){
+      if(west_of(*(e + 1), *e, 2 * bottom) or west_of(*(e + 1), *e, 2 * top)){
+        // Crossing edges.
+        return;
+      }
+    }
+
+    if(high - low > 1){
+      const std::size_t middle = (low + high) / 2;
+      nodes.emplace_back(2 * k, low, middle);
+      nodes.emplace_back(2 * k + 1, middle, high);
+    }
+  }
+
+  _breakpoints = std::move(values);
+  _edge_offsets = std::move(offsets);
+  _suffix_sums.resize(node_edges.size());
+  for(std::size_t k = 0; k + 1 < _edge_offsets.size(); ++k){
+    int32_t sum = 0;
+    for(std::size_t e = _edge_offsets[k + 1]; e > _edge_offsets[k]; --e){
+      const uint32_t i = node_edges[e - 1];
+      sum += (ys[i] < ys[i + 1]) ? 1 : -1;
+      _suffix_sums[e - 1] = sum;
+    }
+  }
+  for(auto i: node_edges){
+    _edges.push_back(xs[i], ys[i], xs[i + 1], ys[i + 1]);
+  }
+  _leaves = leaves;
+}
+
+bool ring_locator::empty() const{
+  return _leaves == 0;
+}
+
+int ring_locator::winding_number(const osmium::Location& loc) const{
+  if((loc.y() < _breakpoints.front()) or (loc.y() >= _breakpoints.back())){
+    // No edge spans this y value.
+    return 0;
+  }
+  const std::size_t leaf
+    = std::upper_bound(_breakpoints.begin(), _breakpoints.end(), loc.y())
+    - _breakpoints.begin() - 1;
+
+  // Edge e contributes if loc is on its west side, the same way as
+  // in edge_winding.
+  auto contributes = [&](std::size_t e){
+    const int64_t side = check_left(loc,
+                                    osmium::Location(_edges.x1[e], _edges.y1[e]),
+                                    osmium::Location(_edges.x2[e], _edges.y2[e]));
+    return (_edges.y1[e] < _edges.y2[e]) ? (side > 0) : (side < 0);
+  };
+
+  int wn = 0;
+  std::size_t k = 1;
+  std::size_t low = 0;
+  std::size_t high = _leaves;
+  while(true){
+    // Binary search for the first contributing edge of the node.
+    std::size_t first = _edge_offsets[k];
+    std::size_t last = _edge_offsets[k + 1];
+    while(first < last){
+      const std::size_t middle = (first + last) / 2;
+      if(contributes(middle)){
+        last = middle;
+      }
+      else{
+        first = middle + 1;
+      }
+    }
+    if(first < _edge_offsets[k + 1]){
+      wn += _suffix_sums[first];
+    }
+
+    if(high - low == 1){
+      break;
+    }
+    const std::size_t middle = (low + high) / 2;
+    if(leaf < middle){
+      k = 2 * k;
+      high = middle;
+    }
+    else{
+      k = 2 * k + 1;
+      low = middle;
+    }
+  }
+  return wn;
+}
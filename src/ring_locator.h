@@ -0,0 +1,54 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef RING_LOCATOR_H
+#define RING_LOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include <osmium/osm/location.hpp>
+#include "winding.h"
+
+// Segment tree over the intervals between distinct vertex y values
+// of a ring. Each edge is stored in the O(log n) nodes whose y range
+// it spans, edges of a node being sorted from west to east. As edges
+// do not cross within a node range, edges contributing to the winding
+// number of a location form a suffix of each node list, found with a
+// binary search.
+class ring_locator{
+private:
+  std::vector<int32_t> _breakpoints;
+
+  // Edges stored in node k are in [_edge_offsets[k],
+  // _edge_offsets[k + 1]), with the sum of the directions of the
+  // edges from each one to the end of the node list.
+  std::vector<uint32_t> _edge_offsets;
+  edge_arrays _edges;
+  std::vector<int32_t> _suffix_sums;
+
+  std::size_t _leaves;
+
+public:
+  ring_locator();
+
+  // Ring with size vertices, the last one being equal to the first.
+  // Leave the locator empty if edges cross each other or if
+  // coordinate differences may wrap around.
+  ring_locator(const int32_t* xs,
+               const int32_t* ys,
+               std::size_t size,
+               int32_t min_x,
+               int32_t max_x);
+
+  bool empty() const;
+
+  int winding_number(const osmium::Location& loc) const;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include <algorithm>
+#include <numeric>
+#include "slab_index.h"
+
+// Number of distinct vertex y values per slab, keeping the tree
+// shallow at the cost of a few more edges per leaf.
+constexpr std::size_t values_per_slab = 8;
+
+slab_index::slab_index():
+  _leaves(0){}
+
+slab_index::slab_index(const int32_t* xs,
+                       const int32_t* ys,
+                       std::size_t size){
+  const std::size_t edges_number = size - 1;
+
+  std::vector<int32_t> values(ys, ys + edges_number);
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+
+  for(std::size_t i = 0; i < values.size(); i += values_per_slab){
+    _breakpoints.push_back(values[i]);
+  }
+  if(_breakpoints.back() != values.back()){
+    _breakpoints.push_back(values.back());
+  }
+
+  // Range of slabs overlapped by the y-span [low, high) of edge i.
+  auto slab_range = [&](std::size_t i){
+    const int32_t low = std::min(ys[i], ys[i + 1]);
+    const int32_t high = std::max(ys[i], ys[i + 1]);
+    const std::size_t first
+      = std::upper_bound(_breakpoints.begin(), _breakpoints.end(), low)
+      - _breakpoints.begin() - 1;
+    const std::size_t last
+      = std::lower_bound(_breakpoints.begin(), _breakpoints.end(), high)
+      - _breakpoints.begin();
+    return std::make_pair(first, last);
+  };
+
+  const std::size_t slabs_number = _breakpoints.size() - 1;
+  _leaves = 1;
+  while(_leaves < slabs_number){
+    _leaves *= 2;
+  }
+
+  // Counting pass then filling pass to store edge lists
+  // contiguously. Horizontal edges never contribute.
+  _edge_offsets.assign(2 * _leaves + 1, 0);
+  for(std::size_t i = 0; i < edges_number; ++i){
+    if(ys[i] == ys[i + 1]){
+      continue;
+    }
+    const auto range = slab_range(i);
+    for_each_node(range.first, range.second, [&](std::size_t k){
+        ++_edge_offsets[k + 1];
+      });
+  }
+  std::partial_sum(_edge_offsets.begin(),
+                   _edge_offsets.end(),
+                   _edge_offsets.begin());
+
+  std::vector<std::size_t> positions(_edge_offsets.begin(),
+                                     _edge_offsets.end() - 1);
+  _edges.x1.resize(_edge_offsets.back());
+  _edges.y1.resize(_edge_offsets.back());
+  _edges.x2.resize(_edge_offsets.back());
+  _edges.y2.resize(_edge_offsets.back());
+  for(std::size_t i = 0; i < edges_number; ++i){
+    if(ys[i] == ys[i + 1]){
+      continue;
+    }
+    const auto range = slab_range(i);
+    for_each_node(range.first, range.second, [&](std::size_t k){
+        const auto position = positions[k]++;
+        _edges.x1[position] = xs[i];
+        _edges.y1[position] = ys[i];
+        _edges.x2[position] = xs[i + 1];
+        _edges.y2[position] = ys[i + 1];
+      });
+  }
+}
+
+bool slab_index::empty() const{
+  return _breakpoints.empty();
+}
+
+int slab_index::winding_number(const osmium::Location& loc) const{
+  if((loc.y() < _breakpoints.front()) or (loc.y() >= _breakpoints.back())){
+    // No edge spans this y value.
+    return 0;
+  }
+  const std::size_t slab
+    = std::upper_bound(_breakpoints.begin(), _breakpoints.end(), loc.y())
+    - _breakpoints.begin() - 1;
+
+  int winding = 0;
+  for(std::size_t k = _leaves + slab; k > 0; k /= 2){
+    if(_edge_offsets[k] < _edge_offsets[k + 1]){
+      winding += _edges.winding_number(_edge_offsets[k],
+                                       _edge_offsets[k + 1],
+                                       loc);
+    }
+  }
+  return winding;
+}
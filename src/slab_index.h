@@ -0,0 +1,64 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef SLAB_INDEX_H
+#define SLAB_INDEX_H
+
+#include <cstdint>
+#include <vector>
+#include <osmium/osm/location.hpp>
+#include "winding.h"
+
+// Horizontal slabs delimited by sorted y values of the ring
+// vertices, with a segment tree over slabs. Each edge is stored in
+// the few tree nodes covering its y-span, so that only edges possibly
+// crossing the horizontal line through a location are visited to
+// compute its winding number: those of the nodes on the path from
+// its slab to the root.
+class slab_index{
+private:
+  // Slab i spans y values in [_breakpoints[i], _breakpoints[i + 1]).
+  std::vector<int32_t> _breakpoints;
+
+  // Number of leaves in the tree, a power of two. Node k has children
+  // 2k and 2k + 1, slab i being leaf _leaves + i.
+  std::size_t _leaves;
+
+  // Edges of each node, stored contiguously.
+  std::vector<uint32_t> _edge_offsets;
+  edge_arrays _edges;
+
+  // Call f with each node of the minimal set covering slabs in
+  // [first, last).
+  template<class F>
+  void for_each_node(std::size_t first, std::size_t last, F f) const{
+    for(first += _leaves, last += _leaves; first < last; first /= 2, last /= 2){
+      if(first % 2 == 1){
+        f(first++);
+      }
+      if(last % 2 == 1){
+        f(--last);
+      }
+    }
+  }
+
+public:
+  slab_index();
+
+  // Ring with size vertices, the last one being equal to the first.
+  slab_index(const int32_t* xs,
+             const int32_t* ys,
+             std::size_t size);
+
+  bool empty() const;
+
+  int winding_number(const osmium::Location& loc) const;
+};
+
+#endif
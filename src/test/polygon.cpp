@@ -10,8 +10,27 @@ All rights reserved (see LICENSE).
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Polygon
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <osmium/builder/attr.hpp>
+#include <osmium/io/pbf_input.hpp>
+#include <osmium/io/pbf_output.hpp>
 #include "../../include/rapidjson/document.h"
+#include "../cell_covering.h"
+#include "../geojson.h"
+#include "../id_set.h"
+#include "../node_checker.h"
+#include "../packed_rtree.h"
+#include "../pbf_blobs.h"
+#include "../polygon_index.h"
 #include "../polygon.h"
+#include "../ring_locator.h"
+#include "../slab_index.h"
+#include "../winding.h"
 
 struct test_data{
   rapidjson::Document json_data;
@@ -319,6 +338,24 @@ BOOST_AUTO_TEST_CASE(poly_hole_test_no_contains_outside){
   BOOST_CHECK(!p.contains({6.0, 1.5}));
 }
 
+BOOST_AUTO_TEST_CASE(poly_hole_test_contains_batch){
+  std::vector<osmium::Location> locations;
+  for(double x = 0.5; x <= 7.5; x += 0.5){
+    for(double y = 0.5; y <= 7.5; y += 0.5){
+      locations.emplace_back(x, y);
+    }
+  }
+  // Already set values are kept.
+  std::vector<bool> contained(locations.size(), false);
+  contained[0] = true;
+  p.contains_batch(locations, contained);
+
+  BOOST_CHECK(contained[0]);
+  for(std::size_t i = 1; i < locations.size(); ++i){
+    BOOST_CHECK_EQUAL(contained[i], p.contains(locations[i]));
+  }
+}
+
 BOOST_AUTO_TEST_CASE(poly_hole_test_exclude_hole){
   // In the hole.
   BOOST_CHECK(!p.contains({4.0, 3.5}));
@@ -335,3 +372,1319 @@ BOOST_AUTO_TEST_CASE(poly_hole_test_exclude_hole){
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+// Reference check walking all edges of all rings.
+bool walk_all_edges(const rapidjson::Value& json_rings,
+                    const osmium::Location& loc){
+  bool contained = false;
+  for(rapidjson::SizeType r = 0; r < json_rings.Size(); ++r){
+    int wn = 0;
+    for(rapidjson::SizeType i = 0; i < json_rings[r].Size() - 1; ++i){
+      osmium::Location l1(json_rings[r][i][0].GetDouble(),
+                          json_rings[r][i][1].GetDouble());
+      osmium::Location l2(json_rings[r][i + 1][0].GetDouble(),
+                          json_rings[r][i + 1][1].GetDouble());
+      wn += edge_winding(loc, l1, l2);
+    }
+    if(r == 0){
+      contained = (wn != 0);
+    }
+    else{
+      contained &= (wn == 0);
+    }
+  }
+  return contained;
+}
+
+std::string json_point(double x, double y){
+  return "[" + std::to_string(x) + "," + std::to_string(y) + "]";
+}
+
+// Comb with axis-aligned teeth and a hole, so that many lattice
+// points lie on edges and vertices.
+std::string comb_rings(){
+  std::string outer = json_point(0, 0) + "," + json_point(60, 0);
+  for(int t = 29; t >= 0; --t){
+    outer += "," + json_point(2 * t + 2, 10 + (t % 7))
+      + "," + json_point(2 * t + 1, 10 + (t % 7))
+      + "," + json_point(2 * t + 1, 5)
+      + "," + json_point(2 * t, 5);
+  }
+  outer += "," + json_point(0, 0);
+  std::string hole = json_point(10, 1) + "," + json_point(10, 3)
+    + "," + json_point(30, 3) + "," + json_point(30, 1)
+    + "," + json_point(10, 1);
+  return "[[" + outer + "],[" + hole + "]]";
+}
+
+// Star with many spikes and no aligned coordinates.
+std::string star_rings(){
+  std::string outer;
+  const int spikes = 150;
+  for(int i = 0; i <= 2 * spikes; ++i){
+    const double angle = M_PI * (i % (2 * spikes)) / spikes;
+    const double radius = (i % 2 == 0) ? 10.0 : 4.0 + (i % 5);
+    outer += ((i == 0) ? "" : ",")
+      + json_point(13.4 + radius * std::cos(angle) / 7.0,
+                   52.5 + radius * std::sin(angle) / 11.0);
+  }
+  return "[[" + outer + "]]";
+}
+
+// Square with a finely jagged left side, so that grid cells along
+// that side are crowded with edges.
+std::string coast_rings(){
+  std::string outer = json_point(0, 0) + "," + json_point(80, 0)
+    + "," + json_point(80, 80) + "," + json_point(0, 80);
+  const int teeth = 20000;
+  for(int t = 1; t < teeth; ++t){
+    outer += "," + json_point((t % 2 == 0) ? 0.0 : 0.5 + (t % 3) * 0.25,
+                              80.0 - 80.0 * t / teeth);
+  }
+  outer += "," + json_point(0, 0);
+  return "[[" + outer + "]]";
+}
+
+struct init_state_grid{
+  test_data comb_json;
+  test_data star_json;
+  polygon comb;
+  polygon star;
+  init_state_grid():
+    comb_json(comb_rings()),
+    star_json(star_rings()),
+    comb("Comb", comb_json.get_data()),
+    star("Star", star_json.get_data()){}
+};
+
+BOOST_FIXTURE_TEST_SUITE(grid_checks, init_state_grid)
+
+BOOST_AUTO_TEST_CASE(grid_comb_lattice){
+  test_data json(comb_rings());
+  auto rings = json.get_data();
+  for(double x = -1.0; x <= 61.0; x += 0.25){
+    for(double y = -1.0; y <= 18.0; y += 0.25){
+      osmium::Location loc(x, y);
+      BOOST_CHECK_EQUAL(comb.contains(loc), walk_all_edges(rings, loc));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(grid_star_lattice){
+  test_data json(star_rings());
+  auto rings = json.get_data();
+  for(int32_t x = 117000000; x <= 151000000; x += 70001){
+    for(int32_t y = 515000000; y <= 535000000; y += 40003){
+      osmium::Location loc(x, y);
+      BOOST_CHECK_EQUAL(star.contains(loc), walk_all_edges(rings, loc));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(grid_star_corners){
+  test_data json(star_rings());
+  auto rings = json.get_data();
+  for(rapidjson::SizeType i = 0; i < rings[0].Size(); ++i){
+    osmium::Location corner(rings[0][i][0].GetDouble(),
+                            rings[0][i][1].GetDouble());
+    for(int32_t dx = -1; dx <= 1; ++dx){
+      for(int32_t dy = -1; dy <= 1; ++dy){
+        osmium::Location loc(corner.x() + dx, corner.y() + dy);
+        BOOST_CHECK_EQUAL(star.contains(loc), walk_all_edges(rings, loc));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(grid_crowded_coast){
+  test_data json(coast_rings());
+  auto rings = json.get_data();
+  test_data coast_json(coast_rings());
+  polygon coast("Coast", coast_json.get_data());
+  for(double x = -0.1; x <= 1.5; x += 0.05){
+    for(double y = 0.0; y <= 80.0; y += 1.3){
+      osmium::Location loc(x, y);
+      BOOST_CHECK_EQUAL(coast.contains(loc), walk_all_edges(rings, loc));
+    }
+  }
+  for(rapidjson::SizeType i = 0; i < rings[0].Size(); i += 97){
+    osmium::Location corner(rings[0][i][0].GetDouble(),
+                            rings[0][i][1].GetDouble());
+    BOOST_CHECK_EQUAL(coast.contains(corner), walk_all_edges(rings, corner));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(winding_kernel_checks)
+
+BOOST_AUTO_TEST_CASE(kernel_matches_edge_winding){
+  std::mt19937 gen(12);
+  // Small ranges to get many aligned and equal coordinates.
+  for(int32_t range: {4, 1000, 1 << 30}){
+    std::uniform_int_distribution<int32_t> coordinate(-range, range);
+    for(int trial = 0; trial < 200; ++trial){
+      const std::size_t n = trial % 37;
+      std::vector<int32_t> xs(n + 1);
+      std::vector<int32_t> ys(n + 1);
+      for(std::size_t i = 0; i <= n; ++i){
+        xs[i] = coordinate(gen);
+        ys[i] = coordinate(gen);
+      }
+      const osmium::Location loc(coordinate(gen), coordinate(gen));
+
+      int expected = 0;
+      for(std::size_t i = 0; i < n; ++i){
+        expected += edge_winding(loc,
+                                 osmium::Location(xs[i], ys[i]),
+                                 osmium::Location(xs[i + 1], ys[i + 1]));
+      }
+      BOOST_CHECK_EQUAL(winding_number(xs.data(), ys.data(),
+                                       xs.data() + 1, ys.data() + 1,
+                                       n, loc.x(), loc.y()),
+                        expected);
+      BOOST_CHECK_EQUAL(scalar_winding_number(xs.data(), ys.data(),
+                                              xs.data() + 1, ys.data() + 1,
+                                              n, loc.x(), loc.y()),
+                        expected);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_full_range){
+  // Coordinate differences wrap around, kernels have to agree.
+  std::mt19937 gen(21);
+  std::uniform_int_distribution<int32_t> coordinate;
+  for(int trial = 0; trial < 200; ++trial){
+    const std::size_t n = 1 + trial % 29;
+    std::vector<int32_t> xs(n + 1);
+    std::vector<int32_t> ys(n + 1);
+    for(std::size_t i = 0; i <= n; ++i){
+      xs[i] = coordinate(gen);
+      ys[i] = coordinate(gen);
+    }
+    const int32_t x = coordinate(gen);
+    const int32_t y = coordinate(gen);
+    BOOST_CHECK_EQUAL(winding_number(xs.data(), ys.data(),
+                                     xs.data() + 1, ys.data() + 1,
+                                     n, x, y),
+                      scalar_winding_number(xs.data(), ys.data(),
+                                            xs.data() + 1, ys.data() + 1,
+                                            n, x, y));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Small adjacent squares, some of them with a hole.
+std::string tile_rings(int i, int j){
+  const double x = 13.0 + 0.01 * i;
+  const double y = 52.3 + 0.01 * j;
+  std::string outer = json_point(x, y) + "," + json_point(x + 0.01, y)
+    + "," + json_point(x + 0.01, y + 0.01) + "," + json_point(x, y + 0.01)
+    + "," + json_point(x, y);
+  if((i + j) % 3 != 0){
+    return "[[" + outer + "]]";
+  }
+  std::string hole = json_point(x + 0.002, y + 0.003)
+    + "," + json_point(x + 0.002, y + 0.007)
+    + "," + json_point(x + 0.008, y + 0.003)
+    + "," + json_point(x + 0.002, y + 0.003);
+  return "[[" + outer + "],[" + hole + "]]";
+}
+
+struct init_state_covering{
+  std::vector<std::string> sources;
+  polygon_set polygons;
+  init_state_covering(){
+    sources.push_back(star_rings());
+    sources.push_back(comb_rings());
+    for(int i = 0; i < 12; ++i){
+      for(int j = 0; j < 12; ++j){
+        sources.push_back(tile_rings(i, j));
+      }
+    }
+    for(std::size_t p = 0; p < sources.size(); ++p){
+      test_data json(sources[p]);
+      polygons.add_polygon("Polygon_" + std::to_string(p), json.get_data());
+    }
+  }
+
+  bool in_any_polygon(const osmium::Location& loc) const{
+    for(std::size_t p = 0; p < polygons.size(); ++p){
+      if(polygons.contains(p, loc)){
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(covering_checks, init_state_covering)
+
+BOOST_AUTO_TEST_CASE(set_matches_standalone_polygons){
+  BOOST_CHECK_EQUAL(polygons.size(), sources.size());
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int32_t> x_coordinate(129000000, 135000000);
+  std::uniform_int_distribution<int32_t> y_coordinate(522000000, 532000000);
+  for(std::size_t p = 0; p < sources.size(); p += 7){
+    test_data json(sources[p]);
+    polygon standalone("Standalone", json.get_data());
+    BOOST_CHECK_EQUAL(polygons.name(p), "Polygon_" + std::to_string(p));
+    BOOST_CHECK(standalone.bbox() == polygons.bbox(p));
+    for(int trial = 0; trial < 500; ++trial){
+      osmium::Location loc(x_coordinate(gen), y_coordinate(gen));
+      BOOST_CHECK_EQUAL(polygons.contains(p, loc), standalone.contains(loc));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(covering_has_interior_cells){
+  cell_covering covering(polygons);
+  BOOST_CHECK(!covering.empty());
+  BOOST_CHECK(covering.interior_cells() > 0);
+  BOOST_CHECK(covering.interior_cells() < covering.size());
+}
+
+BOOST_AUTO_TEST_CASE(covering_matches_polygons){
+  cell_covering covering(polygons);
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<int32_t> x_coordinate(115000000, 155000000);
+  std::uniform_int_distribution<int32_t> y_coordinate(510000000, 540000000);
+  for(int trial = 0; trial < 20000; ++trial){
+    osmium::Location loc(x_coordinate(gen), y_coordinate(gen));
+    BOOST_CHECK_EQUAL(covering.contains(loc), in_any_polygon(loc));
+  }
+  // Tile corners and edges, with neighbouring locations.
+  for(int i = 0; i <= 12; ++i){
+    for(int j = 0; j <= 12; ++j){
+      const osmium::Location corner(13.0 + 0.01 * i, 52.3 + 0.01 * j);
+      for(int32_t dx = -1; dx <= 1; ++dx){
+        for(int32_t dy = -1; dy <= 1; ++dy){
+          osmium::Location loc(corner.x() + dx, corner.y() + dy);
+          BOOST_CHECK_EQUAL(covering.contains(loc), in_any_polygon(loc));
+          loc.set_x(corner.x() + 50000 + dx);
+          BOOST_CHECK_EQUAL(covering.contains(loc), in_any_polygon(loc));
+        }
+      }
+    }
+  }
+  for(double x = -1.0; x <= 61.0; x += 0.5){
+    for(double y = -1.0; y <= 18.0; y += 0.5){
+      osmium::Location loc(x, y);
+      BOOST_CHECK_EQUAL(covering.contains(loc), in_any_polygon(loc));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(cell_box_matches_keys){
+  std::mt19937 gen(4);
+  std::uniform_int_distribution<int32_t> coordinate;
+  for(unsigned level: {1u, 16u, 31u, 32u}){
+    const unsigned shift = 2 * (32 - level);
+    for(int trial = 0; trial < 100; ++trial){
+      const osmium::Location loc(coordinate(gen), coordinate(gen));
+      const osmium::Box cell = cell_covering::cell_box(loc, level);
+      BOOST_CHECK(cell.bottom_left().x() <= loc.x());
+      BOOST_CHECK(cell.bottom_left().y() <= loc.y());
+      BOOST_CHECK(loc.x() <= cell.top_right().x());
+      BOOST_CHECK(loc.y() <= cell.top_right().y());
+      const uint64_t key = cell_covering::key(loc);
+      BOOST_CHECK_EQUAL(cell_covering::key(cell.bottom_left()) >> shift,
+                        key >> shift);
+      BOOST_CHECK_EQUAL(cell_covering::key(cell.top_right()) >> shift,
+                        key >> shift);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(classify_boxes){
+  std::mt19937 gen(8);
+  std::uniform_int_distribution<int32_t> x_coordinate(125000000, 145000000);
+  std::uniform_int_distribution<int32_t> y_coordinate(520000000, 535000000);
+  std::uniform_int_distribution<int32_t> extent(0, 300000);
+  std::uniform_int_distribution<int32_t> offset(0, 1 << 30);
+  for(int trial = 0; trial < 2000; ++trial){
+    const int32_t x = x_coordinate(gen);
+    const int32_t y = y_coordinate(gen);
+    const int32_t width = extent(gen);
+    const int32_t height = extent(gen);
+    const osmium::Box box(osmium::Location(x, y),
+                          osmium::Location(x + width, y + height));
+    const std::size_t p = trial % polygons.size();
+    const auto position = polygons.classify(p, box);
+    if(position == box_position::boundary){
+      continue;
+    }
+    // All locations share the same status.
+    for(int s = 0; s < 50; ++s){
+      osmium::Location loc(x + offset(gen) % (width + 1),
+                           y + offset(gen) % (height + 1));
+      if(s < 4){
+        loc = osmium::Location((s % 2 == 0) ? x : x + width,
+                               (s < 2) ? y : y + height);
+      }
+      BOOST_CHECK_EQUAL(polygons.contains(p, loc),
+                        position == box_position::inside);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Square with a lattice of small holes, some of them overlapping
+// several index cells.
+std::string holed_rings(){
+  std::string rings = "[[" + json_point(0, 0) + "," + json_point(30, 0)
+    + "," + json_point(30, 30) + "," + json_point(0, 30)
+    + "," + json_point(0, 0) + "]";
+  for(int i = 0; i < 14; ++i){
+    for(int j = 0; j < 14; ++j){
+      const double x = 1.0 + 2.0 * i;
+      const double y = 1.0 + 2.0 * j;
+      const double size = ((i + j) % 4 == 0) ? 2.5 : 1.0;
+      rings += ",[" + json_point(x, y) + "," + json_point(x, y + size)
+        + "," + json_point(x + size, y) + "," + json_point(x, y) + "]";
+    }
+  }
+  return rings + "]";
+}
+
+BOOST_AUTO_TEST_SUITE(hole_checks)
+
+BOOST_AUTO_TEST_CASE(holes_lattice){
+  test_data json(holed_rings());
+  auto rings = json.get_data();
+  test_data holed_json(holed_rings());
+  polygon holed("Holed", holed_json.get_data());
+
+  std::vector<osmium::Location> locations;
+  for(double x = -0.5; x <= 30.5; x += 0.125){
+    for(double y = -0.5; y <= 30.5; y += 0.375){
+      locations.emplace_back(x, y);
+    }
+  }
+  std::vector<bool> contained(locations.size(), false);
+  holed.contains_batch(locations, contained);
+  for(std::size_t i = 0; i < locations.size(); ++i){
+    const bool expected = walk_all_edges(rings, locations[i]);
+    BOOST_CHECK_EQUAL(holed.contains(locations[i]), expected);
+    BOOST_CHECK_EQUAL(contained[i], expected);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(holes_classify_boxes){
+  test_data json(holed_rings());
+  auto rings = json.get_data();
+  test_data holed_json(holed_rings());
+  polygon holed("Holed", holed_json.get_data());
+
+  std::mt19937 gen(9);
+  std::uniform_real_distribution<double> coordinate(-1.0, 31.0);
+  std::uniform_real_distribution<double> extent(0.0, 1.5);
+  for(int trial = 0; trial < 1000; ++trial){
+    const osmium::Location bl(coordinate(gen), coordinate(gen));
+    const osmium::Location tr(bl.lon() + extent(gen), bl.lat() + extent(gen));
+    const auto position = holed.classify(osmium::Box(bl, tr));
+    if(position == box_position::boundary){
+      continue;
+    }
+    for(int s = 0; s < 9; ++s){
+      const osmium::Location loc(bl.x() + (s % 3) * ((tr.x() - bl.x()) / 2),
+                                 bl.y() + (s / 3) * ((tr.y() - bl.y()) / 2));
+      BOOST_CHECK_EQUAL(walk_all_edges(rings, loc),
+                        position == box_position::inside);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Regular polygon around (10, 20) with rounded coordinates.
+std::string regular_rings(int sides, bool clockwise){
+  std::string outer;
+  for(int i = 0; i <= sides; ++i){
+    const double angle = (clockwise ? -2 : 2) * M_PI * (i % sides) / sides;
+    outer += ((i == 0) ? "" : ",")
+      + json_point(10 + std::round(50000 * std::cos(angle)) / 10000,
+                   20 + std::round(50000 * std::sin(angle)) / 10000);
+  }
+  return "[[" + outer + "]]";
+}
+
+// Y-monotone ring with jagged sides and horizontal steps.
+std::string monotone_rings(){
+  std::string left;
+  std::string right;
+  for(int i = 0; i <= 20; ++i){
+    left = json_point((i % 3) - 1, i) + ((i == 0) ? "" : "," + left);
+    right += "," + json_point(5 + (i % 2), i);
+    if(i % 4 == 0){
+      right += "," + json_point(8, i);
+    }
+  }
+  return "[[" + json_point(-1, 0) + right + "," + left + "]]";
+}
+
+std::string rectangle_rings(bool clockwise){
+  const std::string corners = clockwise ?
+    json_point(1, 2) + "," + json_point(1, 7) + "," + json_point(4, 7)
+    + "," + json_point(4, 2)
+    : json_point(1, 2) + "," + json_point(4, 2) + "," + json_point(4, 7)
+    + "," + json_point(1, 7);
+  return "[[" + corners + "," + json_point(1, 2) + "]]";
+}
+
+void check_lattice(const std::string& rings_string,
+                   double min_x,
+                   double max_x,
+                   double min_y,
+                   double max_y){
+  test_data json(rings_string);
+  auto rings = json.get_data();
+  test_data polygon_json(rings_string);
+  polygon p("Shape", polygon_json.get_data());
+  for(double x = min_x; x <= max_x; x += 0.05){
+    for(double y = min_y; y <= max_y; y += 0.05){
+      const osmium::Location loc(x, y);
+      for(int32_t d = -1; d <= 1; ++d){
+        const osmium::Location near(loc.x() + d, loc.y() - d);
+        BOOST_CHECK_EQUAL(p.contains(near), walk_all_edges(rings, near));
+      }
+    }
+  }
+  for(rapidjson::SizeType i = 0; i < rings[0].Size(); ++i){
+    const osmium::Location corner(rings[0][i][0].GetDouble(),
+                                  rings[0][i][1].GetDouble());
+    for(int32_t dx = -1; dx <= 1; ++dx){
+      for(int32_t dy = -1; dy <= 1; ++dy){
+        const osmium::Location loc(corner.x() + dx, corner.y() + dy);
+        BOOST_CHECK_EQUAL(p.contains(loc), walk_all_edges(rings, loc));
+      }
+    }
+  }
+}
+
+ring_shape outer_shape(const std::string& rings_string){
+  test_data json(rings_string);
+  polygon_set set;
+  set.add_polygon("Shape", json.get_data());
+  return set.shape(0, 0);
+}
+
+BOOST_AUTO_TEST_SUITE(shape_checks)
+
+BOOST_AUTO_TEST_CASE(shapes_detection){
+  BOOST_CHECK(outer_shape(rectangle_rings(false)) == ring_shape::rectangle);
+  BOOST_CHECK(outer_shape(rectangle_rings(true)) == ring_shape::rectangle);
+  BOOST_CHECK(outer_shape(regular_rings(5, false)) == ring_shape::convex);
+  BOOST_CHECK(outer_shape(regular_rings(64, true)) == ring_shape::convex);
+  BOOST_CHECK(outer_shape(monotone_rings()) == ring_shape::monotone);
+  BOOST_CHECK(outer_shape(comb_rings()) == ring_shape::general);
+  BOOST_CHECK(outer_shape(star_rings()) == ring_shape::general);
+}
+
+BOOST_AUTO_TEST_CASE(rectangles_lattice){
+  check_lattice(rectangle_rings(false), 0.5, 4.5, 1.5, 7.5);
+  check_lattice(rectangle_rings(true), 0.5, 4.5, 1.5, 7.5);
+}
+
+BOOST_AUTO_TEST_CASE(convex_lattice){
+  check_lattice(regular_rings(7, false), 4.5, 15.5, 14.5, 25.5);
+  check_lattice(regular_rings(40, true), 4.5, 15.5, 14.5, 25.5);
+}
+
+BOOST_AUTO_TEST_CASE(monotone_lattice){
+  check_lattice(monotone_rings(), -1.5, 8.5, -0.5, 20.5);
+}
+
+BOOST_AUTO_TEST_CASE(shapes_classify_boxes){
+  for(const auto& rings_string: {regular_rings(40, true),
+                                 monotone_rings(),
+                                 rectangle_rings(false)}){
+    test_data json(rings_string);
+    auto rings = json.get_data();
+    test_data polygon_json(rings_string);
+    polygon p("Shape", polygon_json.get_data());
+
+    std::mt19937 gen(6);
+    std::uniform_real_distribution<double> coordinate(-2.0, 26.0);
+    std::uniform_real_distribution<double> extent(0.0, 3.0);
+    for(int trial = 0; trial < 2000; ++trial){
+      const osmium::Location bl(coordinate(gen) / 2, coordinate(gen));
+      const osmium::Location tr(bl.lon() + extent(gen), bl.lat() + extent(gen));
+      const auto position = p.classify(osmium::Box(bl, tr));
+      if(position == box_position::boundary){
+        continue;
+      }
+      for(int s = 0; s < 9; ++s){
+        const osmium::Location loc(bl.x() + (s % 3) * ((tr.x() - bl.x()) / 2),
+                                   bl.y() + (s / 3) * ((tr.y() - bl.y()) / 2));
+        BOOST_CHECK_EQUAL(walk_all_edges(rings, loc),
+                          position == box_position::inside);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(locator_checks)
+
+BOOST_AUTO_TEST_CASE(locator_matches_kernel){
+  std::mt19937 gen(17);
+  // Star-shaped rings are simple, small radii give many aligned
+  // coordinates.
+  for(int32_t range: {8, 1000, 1 << 24}){
+    std::uniform_int_distribution<int32_t> radius(range / 4, range);
+    std::uniform_int_distribution<int32_t> coordinate(-range - 2, range + 2);
+    for(int trial = 0; trial < 20; ++trial){
+      const std::size_t n = 3 + 97 * trial;
+      std::vector<int32_t> xs;
+      std::vector<int32_t> ys;
+      for(std::size_t i = 0; i < n; ++i){
+        const double angle = ((trial % 2 == 0) ? 2 : -2) * M_PI * i / n;
+        const int32_t r = radius(gen);
+        xs.push_back(static_cast<int32_t>(std::lround(r * std::cos(angle))));
+        ys.push_back(static_cast<int32_t>(std::lround(r * std::sin(angle))));
+      }
+      xs.push_back(xs.front());
+      ys.push_back(ys.front());
+      const auto x_range = std::minmax_element(xs.begin(), xs.end());
+      ring_locator locator(xs.data(), ys.data(), xs.size(),
+                           *x_range.first, *x_range.second);
+      if(range > 8){
+        // Rounding may only create crossings for tiny rings.
+        BOOST_CHECK(!locator.empty());
+      }
+      if(locator.empty()){
+        continue;
+      }
+
+      auto check = [&](int32_t x, int32_t y){
+        BOOST_CHECK_EQUAL(locator.winding_number(osmium::Location(x, y)),
+                          scalar_winding_number(xs.data(), ys.data(),
+                                                xs.data() + 1, ys.data() + 1,
+                                                n, x, y));
+      };
+      for(int s = 0; s < 500; ++s){
+        check(coordinate(gen), coordinate(gen));
+      }
+      for(std::size_t i = 0; i < n; ++i){
+        check(xs[i] - 1, ys[i]);
+        check(xs[i], ys[i]);
+        check(xs[i] + 1, ys[i]);
+        check(xs[i], ys[i] + 1);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(slabs_match_kernel){
+  // Comb whose teeth have long vertical edges spanning most slabs,
+  // between many short edges.
+  std::vector<int32_t> xs;
+  std::vector<int32_t> ys;
+  const int32_t teeth = 200;
+  for(int32_t t = 0; t < teeth; ++t){
+    const int32_t top = (t % 5 == 0) ? 10000 : 100 + 37 * (t % 11);
+    xs.insert(xs.end(), {10 * t, 10 * t + 3, 10 * t + 5, 10 * t + 8});
+    ys.insert(ys.end(), {0, top, top + 7, 1 + t % 3});
+  }
+  xs.insert(xs.end(), {10 * teeth, 10 * teeth, 0, 0});
+  ys.insert(ys.end(), {0, -50, -50, 0});
+  const std::size_t n = xs.size() - 1;
+  slab_index slabs(xs.data(), ys.data(), xs.size());
+  BOOST_REQUIRE(!slabs.empty());
+
+  std::mt19937 gen(23);
+  std::uniform_int_distribution<int32_t> x_coordinate(-10, 10 * teeth + 10);
+  std::uniform_int_distribution<int32_t> y_coordinate(-60, 10010);
+  auto check = [&](int32_t x, int32_t y){
+    BOOST_CHECK_EQUAL(slabs.winding_number(osmium::Location(x, y)),
+                      scalar_winding_number(xs.data(), ys.data(),
+                                            xs.data() + 1, ys.data() + 1,
+                                            n, x, y));
+  };
+  for(int s = 0; s < 5000; ++s){
+    check(x_coordinate(gen), y_coordinate(gen));
+  }
+  for(std::size_t i = 0; i < n; ++i){
+    check(xs[i] - 1, ys[i]);
+    check(xs[i], ys[i]);
+    check(xs[i], ys[i] - 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(locator_rejects_crossings){
+  // Bow tie ring.
+  std::vector<int32_t> xs = {0, 10, 10, 0, 0};
+  std::vector<int32_t> ys = {0, 10, 0, 10, 0};
+  ring_locator locator(xs.data(), ys.data(), xs.size(), 0, 10);
+  BOOST_CHECK(locator.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(packed_checks, init_state_covering)
+
+BOOST_AUTO_TEST_CASE(packed_matches_polygons){
+  packed_rtree packed(polygons);
+  BOOST_CHECK(!packed.empty());
+  packed_rtree::windings_t windings;
+  std::mt19937 gen(21);
+  std::uniform_int_distribution<int32_t> x_coordinate(115000000, 155000000);
+  std::uniform_int_distribution<int32_t> y_coordinate(510000000, 540000000);
+  for(int trial = 0; trial < 20000; ++trial){
+    osmium::Location loc(x_coordinate(gen), y_coordinate(gen));
+    BOOST_CHECK_EQUAL(packed.contains(loc, windings), in_any_polygon(loc));
+  }
+  // Tile corners, with neighbouring locations.
+  for(int i = 0; i <= 12; ++i){
+    for(int j = 0; j <= 12; ++j){
+      const osmium::Location corner(13.0 + 0.01 * i, 52.3 + 0.01 * j);
+      for(int32_t dx = -1; dx <= 1; ++dx){
+        for(int32_t dy = -1; dy <= 1; ++dy){
+          osmium::Location loc(corner.x() + dx, corner.y() + dy);
+          BOOST_CHECK_EQUAL(packed.contains(loc, windings), in_any_polygon(loc));
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(packed_classify_boxes){
+  packed_rtree packed(polygons);
+  packed_rtree::windings_t windings;
+  std::vector<uint32_t> ranks;
+  std::mt19937 gen(22);
+  std::uniform_int_distribution<int32_t> x_coordinate(125000000, 145000000);
+  std::uniform_int_distribution<int32_t> y_coordinate(520000000, 535000000);
+  std::uniform_int_distribution<int32_t> extent(0, 300000);
+  std::uniform_int_distribution<int32_t> offset(0, 1 << 30);
+  std::size_t decided = 0;
+  for(int trial = 0; trial < 2000; ++trial){
+    const int32_t x = x_coordinate(gen);
+    const int32_t y = y_coordinate(gen);
+    const int32_t width = extent(gen);
+    const int32_t height = extent(gen);
+    const osmium::Box box(osmium::Location(x, y),
+                          osmium::Location(x + width, y + height));
+    const auto position = packed.classify(box, ranks, windings);
+    if(position != box_position::boundary){
+      ++decided;
+    }
+    for(int s = 0; s < 20; ++s){
+      const osmium::Location loc(x + offset(gen) % (width + 1),
+                                 y + offset(gen) % (height + 1));
+      switch(position){
+      case box_position::inside:
+        BOOST_CHECK(in_any_polygon(loc));
+        break;
+      case box_position::outside:
+        BOOST_CHECK(!in_any_polygon(loc));
+        break;
+      case box_position::boundary:{
+        // Locations are only in listed polygons.
+        bool in_ranks = false;
+        for(auto p: ranks){
+          in_ranks |= polygons.contains(p, loc);
+        }
+        BOOST_CHECK_EQUAL(in_ranks, in_any_polygon(loc));
+        break;
+      }
+      }
+    }
+  }
+  BOOST_CHECK(decided > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(index_checks, init_state_covering)
+
+BOOST_AUTO_TEST_CASE(indexes_match_polygons){
+  // Tiles without the star around them, with holes and gaps giving
+  // cells refined at various levels.
+  polygon_set tiles;
+  for(std::size_t p = 2; p < sources.size(); ++p){
+    test_data json(sources[p]);
+    tiles.add_polygon("Tile", json.get_data());
+  }
+  std::uniform_int_distribution<int32_t> x_coordinate(129500000, 131700000);
+  std::uniform_int_distribution<int32_t> y_coordinate(522500000, 524700000);
+  std::uniform_int_distribution<unsigned> level(12, 24);
+  std::uniform_int_distribution<int32_t> offset(0, 1 << 30);
+  for(const auto& name: index_names()){
+    const auto index = make_index(name, tiles);
+    BOOST_REQUIRE(index);
+    BOOST_CHECK_EQUAL(index->name(), name);
+    BOOST_CHECK(index->memory() > 0);
+
+    std::mt19937 gen(23);
+    std::vector<uint32_t> ranks;
+    for(int trial = 0; trial < 3000; ++trial){
+      const osmium::Location loc(x_coordinate(gen), y_coordinate(gen));
+      const osmium::Box cell = cell_covering::cell_box(loc, level(gen));
+      const auto position = index->classify(cell, ranks);
+      BOOST_CHECK(std::is_sorted(ranks.begin(), ranks.end()));
+      for(int s = 0; s < 20; ++s){
+        const int64_t width = static_cast<int64_t>(cell.top_right().x())
+          - cell.bottom_left().x() + 1;
+        const int64_t height = static_cast<int64_t>(cell.top_right().y())
+          - cell.bottom_left().y() + 1;
+        const osmium::Location sample(static_cast<int32_t>(cell.bottom_left().x() + offset(gen) % width),
+                                      static_cast<int32_t>(cell.bottom_left().y() + offset(gen) % height));
+        bool expected = false;
+        for(std::size_t p = 0; p < tiles.size(); ++p){
+          expected |= tiles.contains(p, sample);
+        }
+        switch(position){
+        case box_position::inside:
+          BOOST_CHECK(expected);
+          break;
+        case box_position::outside:
+          BOOST_CHECK(!expected);
+          break;
+        case box_position::boundary:
+          BOOST_CHECK_EQUAL(index->contains(sample, ranks), expected);
+          break;
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_node_checks){
+  using namespace osmium::builder::attr;
+  osmium::Box extent;
+  for(std::size_t p = 0; p < polygons.size(); ++p){
+    extent.extend(polygons.bbox(p));
+  }
+  std::mt19937 gen(41);
+  std::uniform_int_distribution<int32_t> x_coordinate(extent.bottom_left().x(),
+                                                      extent.top_right().x());
+  std::uniform_int_distribution<int32_t> y_coordinate(extent.bottom_left().y(),
+                                                      extent.top_right().y());
+
+  // Buffers of nodes with increasing ids, the same nodes being also
+  // stored as ids and locations.
+  std::vector<std::shared_ptr<const osmium::memory::Buffer>> buffers;
+  std::vector<std::shared_ptr<const node_locations>> locations;
+  std::set<osmium::object_id_type> expected;
+  osmium::object_id_type id = 1;
+  for(int b = 0; b < 12; ++b){
+    auto buffer = std::make_shared<osmium::memory::Buffer>(1 << 16);
+    auto nodes = std::make_shared<node_locations>();
+    for(int n = 0; n < 300; ++n, ++id){
+      const osmium::Location loc(x_coordinate(gen), y_coordinate(gen));
+      osmium::builder::add_node(*buffer, _id(id), _location(loc));
+      nodes->ids.push_back(id);
+      nodes->locations.push_back(loc);
+      if(in_any_polygon(loc)){
+        expected.insert(id);
+      }
+    }
+    buffers.push_back(buffer);
+    locations.push_back(nodes);
+  }
+
+  const auto index = make_index("rtree", polygons);
+  for(unsigned threads: {1, 4}){
+    const auto inside_nodes = make_id_set("compressed");
+    parallel_node_checker checker(polygons, *index, *inside_nodes, threads);
+    for(std::size_t b = 0; b < buffers.size(); ++b){
+      if(b % 2 == 0){
+        checker.check(buffers[b]);
+      }
+      else{
+        checker.check(locations[b]);
+      }
+    }
+    checker.wait();
+    BOOST_CHECK_EQUAL(checker.statistics().nodes, 12 * 300);
+    BOOST_CHECK_EQUAL(inside_nodes->size(), expected.size());
+    for(auto i: expected){
+      BOOST_CHECK(inside_nodes->get(i));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(unknown_index){
+  BOOST_CHECK(!make_index("kdtree", polygons));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(id_set_checks)
+
+BOOST_AUTO_TEST_CASE(id_sets_match){
+  std::mt19937 gen(31);
+  std::uniform_int_distribution<osmium::object_id_type> id(-100000, 12000000000);
+  std::vector<osmium::object_id_type> ids({0, 1, -1, (1 << 25) - 1, 1 << 25});
+  for(int i = 0; i < 5000; ++i){
+    ids.push_back(id(gen));
+  }
+  // Runs and a chunk crowded enough to switch to a bitmap.
+  for(osmium::object_id_type i = 0; i < 20000; ++i){
+    ids.push_back(3000000000 + i);
+    ids.push_back(4000000000 + 3 * i);
+  }
+  for(const auto& name: id_set_names()){
+    auto set = make_id_set(name);
+    BOOST_REQUIRE(set);
+    if(name != "auto"){
+      BOOST_CHECK_EQUAL(set->name(), name);
+    }
+    BOOST_CHECK_EQUAL(set->size(), 0);
+    for(std::size_t i = 0; i < ids.size(); i += 2){
+      set->set(ids[i]);
+    }
+    std::set<osmium::object_id_type> expected;
+    for(std::size_t i = 0; i < ids.size(); i += 2){
+      expected.insert(ids[i]);
+    }
+    for(int pass = 0; pass < 2; ++pass){
+      BOOST_CHECK_EQUAL(set->size(), expected.size());
+      BOOST_CHECK(set->memory() > 0);
+      for(auto i: ids){
+        BOOST_CHECK_EQUAL(set->get(i), expected.count(i) == 1);
+        BOOST_CHECK_EQUAL(set->get(i + 1), expected.count(i + 1) == 1);
+      }
+      std::vector<bool> results;
+      set->get_batch(ids, results);
+      BOOST_REQUIRE_EQUAL(results.size(), ids.size());
+      for(std::size_t i = 0; i < ids.size(); ++i){
+        BOOST_CHECK_EQUAL(results[i], expected.count(ids[i]) == 1);
+      }
+      std::vector<osmium::object_id_type> visited;
+      set->for_each([&](osmium::object_id_type i){
+          visited.push_back(i);
+        });
+      BOOST_CHECK(std::equal(visited.begin(), visited.end(),
+                             expected.begin(), expected.end()));
+      set = select_id_set(name, std::move(set));
+    }
+  }
+  BOOST_CHECK(!make_id_set("tree"));
+}
+
+BOOST_AUTO_TEST_CASE(sorted_ids_match){
+  std::mt19937 gen(37);
+  std::uniform_int_distribution<osmium::object_id_type> id(-1000, 12000000000);
+  auto first = make_id_set("compressed");
+  auto second = make_id_set("hash");
+  std::set<osmium::object_id_type> expected;
+  for(int i = 0; i < 20000; ++i){
+    const auto value = id(gen);
+    ((i % 3 == 0) ? *first : *second).set(value);
+    expected.insert(value);
+  }
+  // Ids in both sets and consecutive ids.
+  for(osmium::object_id_type i = 500; i < 1500; ++i){
+    first->set(i);
+    second->set(i + 500);
+    expected.insert(i);
+    expected.insert(i + 500);
+  }
+
+  sorted_ids ids({first.get(), second.get()});
+  BOOST_CHECK_EQUAL(ids.size(), expected.size());
+
+  // Query ids with both small steps and large gaps.
+  std::vector<osmium::object_id_type> queries(expected.begin(), expected.end());
+  for(osmium::object_id_type i = -2000; i < 3000; ++i){
+    queries.push_back(i);
+  }
+  for(int i = 0; i < 5000; ++i){
+    queries.push_back(id(gen));
+  }
+  queries.push_back(13000000000);
+  std::sort(queries.begin(), queries.end());
+  queries.erase(std::unique(queries.begin(), queries.end()), queries.end());
+  std::size_t position = 0;
+  for(std::size_t i = 0; i < queries.size(); i += 1 + (i % 7) * (i % 5)){
+    BOOST_CHECK_EQUAL(ids.get(queries[i], position), expected.count(queries[i]) == 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(auto_id_set_selection){
+  // Ids filling a whole dense chunk.
+  auto dense = make_id_set("auto");
+  for(osmium::object_id_type i = 1; i < (1 << 25); i += 2){
+    dense->set(i);
+  }
+  dense = select_id_set("auto", std::move(dense));
+  BOOST_CHECK_EQUAL(dense->name(), "dense");
+  BOOST_CHECK_EQUAL(dense->size(), 1 << 24);
+  BOOST_CHECK(dense->get(12345));
+  BOOST_CHECK(!dense->get(12346));
+
+  // Few ids spread over high values stay compressed.
+  auto sparse = make_id_set("auto");
+  for(osmium::object_id_type i = 0; i < 100000; ++i){
+    sparse->set(5000000000 + 997 * i);
+  }
+  sparse = select_id_set("auto", std::move(sparse));
+  BOOST_CHECK_EQUAL(sparse->name(), "compressed");
+  BOOST_CHECK_EQUAL(sparse->size(), 100000);
+  BOOST_CHECK(sparse->get(5000000000 + 997 * 500));
+  BOOST_CHECK(!sparse->get(5000000000 + 997 * 500 + 1));
+
+  // Explicit names are kept.
+  auto compressed = make_id_set("compressed");
+  for(osmium::object_id_type i = 1; i < 10000000; i += 2){
+    compressed->set(i);
+  }
+  compressed = select_id_set("compressed", std::move(compressed));
+  BOOST_CHECK_EQUAL(compressed->name(), "compressed");
+}
+
+BOOST_AUTO_TEST_CASE(blobs_wanted){
+  // Three blobs of nodes, then a blob of ways.
+  std::vector<blob_info> blobs(4);
+  for(osmium::object_id_type id = 1; id <= 300; ++id){
+    blobs[(id - 1) / 100].range(osmium::item_type::node).extend(id);
+  }
+  for(osmium::object_id_type id = 10; id <= 20; ++id){
+    blobs[3].range(osmium::item_type::way).extend(id);
+  }
+
+  auto nodes = make_id_set("auto");
+  nodes->set(50);
+  nodes->set(60);
+  nodes->set(250);
+  nodes->set(400);
+  auto ways = make_id_set("auto");
+  ways->set(5);
+  mark_wanted(blobs, osmium::item_type::node, *nodes);
+  mark_wanted(blobs, osmium::item_type::way, *ways);
+
+  BOOST_CHECK_EQUAL(blobs[0].max_wanted, 2);
+  BOOST_CHECK_EQUAL(blobs[1].max_wanted, 0);
+  BOOST_CHECK_EQUAL(blobs[2].max_wanted, 1);
+  BOOST_CHECK_EQUAL(blobs[3].max_wanted, 0);
+  BOOST_CHECK_EQUAL(blobs[3].count(), 11);
+
+  ways->set(15);
+  mark_wanted(blobs, osmium::item_type::way, *ways);
+  BOOST_CHECK_EQUAL(blobs[3].max_wanted, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(pbf_checks)
+
+BOOST_AUTO_TEST_CASE(blob_reader_filters_ids){
+  using namespace osmium::builder::attr;
+  const std::string file_name = "blob_reader_checks.osm.pbf";
+  auto location = [](osmium::object_id_type id){
+    return osmium::Location(static_cast<int32_t>(1000 * id),
+                            static_cast<int32_t>(-500 * id));
+  };
+
+  // Node 1001 is deleted, as found in history files.
+  {
+    osmium::io::File file(file_name);
+    file.set_has_multiple_object_versions(true);
+    osmium::io::Writer writer(file, osmium::io::overwrite::allow);
+    osmium::memory::Buffer buffer(1 << 16, osmium::memory::Buffer::auto_grow::yes);
+    for(osmium::object_id_type id = 1; id <= 1000; ++id){
+      osmium::builder::add_node(buffer,
+                                _id(id),
+                                _version(2),
+                                _location(location(id)),
+                                _tag("k", "v"));
+    }
+    osmium::builder::add_node(buffer,
+                              _id(1001),
+                              _version(3),
+                              _deleted(),
+                              _location(location(1001)));
+    for(osmium::object_id_type id = 1; id <= 100; ++id){
+      osmium::builder::add_way(buffer, _id(id), _nodes({id, id + 1}));
+    }
+    writer(std::move(buffer));
+    writer.close();
+  }
+
+  const auto read_types = osmium::osm_entity_bits::node
+    | osmium::osm_entity_bits::way;
+
+  // Node ids and locations only.
+  std::vector<blob_info> blobs;
+  osmium::object_id_type next_node = 1;
+  std::size_t ways = 0;
+  {
+    blob_reader reader(file_name, read_types, osmium::io::read_meta::no, true);
+    pbf_blob blob;
+    while(reader.read(blob)){
+      blobs.push_back(blob.info);
+      for(std::size_t i = 0; i < blob.nodes.ids.size(); ++i, ++next_node){
+        BOOST_CHECK_EQUAL(blob.nodes.ids[i], next_node);
+        if(next_node <= 1000){
+          BOOST_CHECK(blob.nodes.locations[i] == location(next_node));
+        }
+        else{
+          BOOST_CHECK(!blob.nodes.locations[i].valid());
+        }
+      }
+      BOOST_CHECK(blob.buffer.select<osmium::Node>().empty());
+      ways += std::distance(blob.buffer.select<osmium::Way>().begin(),
+                            blob.buffer.select<osmium::Way>().end());
+    }
+  }
+  BOOST_CHECK_EQUAL(next_node, 1002);
+  BOOST_CHECK_EQUAL(ways, 100);
+  uint32_t count = 0;
+  for(const auto& blob: blobs){
+    count += blob.count();
+  }
+  BOOST_CHECK_EQUAL(count, 1101);
+
+  // Full objects with even ids only.
+  std::size_t kept = 0;
+  {
+    blob_reader reader(file_name, read_types, osmium::io::read_meta::yes, blobs, false);
+    reader.set_id_filter([](osmium::item_type, osmium::object_id_type id){
+        return id % 2 == 0;
+      });
+    pbf_blob blob;
+    while(reader.read(blob)){
+      BOOST_CHECK(blob.raw.empty());
+      const auto& buffer = blob.buffer;
+      for(const auto& object: buffer.select<osmium::OSMObject>()){
+        ++kept;
+        BOOST_CHECK_EQUAL(object.id() % 2, 0);
+        BOOST_CHECK_EQUAL(object.version(), (object.type() == osmium::item_type::node) ? 2 : 0);
+      }
+      for(const auto& node: buffer.select<osmium::Node>()){
+        BOOST_CHECK(node.location() == location(node.id()));
+        BOOST_CHECK_EQUAL(node.tags().get_value_by_key("k"), "v");
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(kept, 550);
+
+  // Blobs with all objects wanted are returned as stored.
+  for(auto& blob: blobs){
+    blob.max_wanted = blob.count();
+  }
+  std::size_t raw_blobs = 0;
+  {
+    blob_reader reader(file_name, read_types, osmium::io::read_meta::yes, blobs, true);
+    pbf_blob blob;
+    while(reader.read(blob)){
+      ++raw_blobs;
+      BOOST_CHECK_EQUAL(blob.raw.size(), blob.info.size);
+      BOOST_CHECK_EQUAL(blob.buffer.committed(), 0);
+    }
+  }
+  BOOST_CHECK_EQUAL(raw_blobs, blobs.size());
+
+  // Blobs kept in memory are decoded as if read from the file.
+  std::vector<std::string> stored;
+  {
+    blob_reader reader(file_name, read_types, osmium::io::read_meta::no, true);
+    reader.keep_raw(true);
+    pbf_blob blob;
+    while(reader.read(blob)){
+      BOOST_CHECK_EQUAL(blob.raw.size(), blob.info.size);
+      stored.push_back(std::move(blob.raw));
+    }
+  }
+  BOOST_REQUIRE_EQUAL(stored.size(), blobs.size());
+
+  // The first blob is read again from the file.
+  auto twice = blobs;
+  twice.push_back(blobs.front());
+  stored.emplace_back();
+  std::size_t objects = 0;
+  {
+    blob_reader reader(file_name, read_types, osmium::io::read_meta::yes, twice, false);
+    reader.set_stored(std::move(stored));
+    pbf_blob blob;
+    while(reader.read(blob)){
+      for(const auto& node: blob.buffer.select<osmium::Node>()){
+        ++objects;
+        BOOST_CHECK(node.location() == (node.visible() ? location(node.id()) : osmium::Location()));
+      }
+      objects += std::distance(blob.buffer.select<osmium::Way>().begin(),
+                               blob.buffer.select<osmium::Way>().end());
+    }
+  }
+  BOOST_CHECK_EQUAL(objects, 1101 + blobs.front().count());
+  std::remove(file_name.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(blob_reader_checks_raw_blobs){
+  using namespace osmium::builder::attr;
+  const std::string file_name = "raw_blob_checks.osm.pbf";
+
+  // Node 5 is missing, node 11 is not wanted.
+  {
+    osmium::io::Writer writer(file_name, osmium::io::overwrite::allow);
+    osmium::memory::Buffer buffer(1 << 12, osmium::memory::Buffer::auto_grow::yes);
+    for(osmium::object_id_type id = 1; id <= 11; ++id){
+      if(id != 5){
+        osmium::builder::add_node(buffer,
+                                  _id(id),
+                                  _location(osmium::Location(static_cast<int32_t>(id),
+                                                             static_cast<int32_t>(id))));
+      }
+    }
+    writer(std::move(buffer));
+    writer.close();
+  }
+
+  std::vector<blob_info> blobs;
+  {
+    blob_reader reader(file_name, osmium::osm_entity_bits::node, osmium::io::read_meta::no, true);
+    pbf_blob blob;
+    while(reader.read(blob)){
+      blobs.push_back(blob.info);
+    }
+  }
+  BOOST_REQUIRE_EQUAL(blobs.size(), 1);
+
+  // Wanted node 5 is counted without being in the blob.
+  auto nodes = make_id_set("auto");
+  for(osmium::object_id_type id = 1; id <= 10; ++id){
+    nodes->set(id);
+  }
+  mark_wanted(blobs, osmium::item_type::node, *nodes);
+  BOOST_CHECK_EQUAL(blobs.front().max_wanted, blobs.front().count());
+
+  auto read = [&](const id_set& wanted){
+    blob_reader reader(file_name, osmium::osm_entity_bits::node, osmium::io::read_meta::yes, blobs, true);
+    reader.set_id_filter([&wanted](osmium::item_type, osmium::object_id_type id){
+        return wanted.get(id);
+      });
+    pbf_blob blob;
+    BOOST_REQUIRE(reader.read(blob));
+    BOOST_CHECK(!reader.read(blob));
+    return blob;
+  };
+
+  // Node 11 is filtered out, so the blob is decoded.
+  pbf_blob blob = read(*nodes);
+  BOOST_CHECK(blob.raw.empty());
+  BOOST_CHECK_EQUAL(blob.buffer.select<osmium::Node>().size(), 9);
+  for(const auto& node: blob.buffer.select<osmium::Node>()){
+    BOOST_CHECK(node.id() <= 10);
+  }
+
+  // All nodes pass the filter, so the blob is copied as stored.
+  nodes->set(11);
+  blob = read(*nodes);
+  BOOST_CHECK_EQUAL(blob.raw.size(), blob.info.size);
+  BOOST_CHECK_EQUAL(blob.buffer.committed(), 0);
+  std::remove(file_name.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(blob_writer_keeps_order){
+  using namespace osmium::builder::attr;
+  const std::string raw_name = "blob_writer_raw.osm.pbf";
+  const std::string file_name = "blob_writer_checks.osm.pbf";
+  auto location = [](osmium::object_id_type id){
+    return osmium::Location(static_cast<int32_t>(id), static_cast<int32_t>(-id));
+  };
+  auto nodes = [&](osmium::object_id_type first, osmium::object_id_type last){
+    osmium::memory::Buffer buffer(1 << 12, osmium::memory::Buffer::auto_grow::yes);
+    for(osmium::object_id_type id = first; id <= last; ++id){
+      osmium::builder::add_node(buffer, _id(id), _version(1), _location(location(id)));
+    }
+    return buffer;
+  };
+
+  // A raw blob for nodes 4 to 6.
+  {
+    osmium::io::Writer writer(raw_name, osmium::io::overwrite::allow);
+    writer(nodes(4, 6));
+    writer.close();
+  }
+  std::string raw;
+  {
+    blob_reader reader(raw_name, osmium::osm_entity_bits::node, osmium::io::read_meta::no, true);
+    reader.keep_raw(true);
+    pbf_blob blob;
+    BOOST_REQUIRE(reader.read(blob));
+    raw = std::move(blob.raw);
+    BOOST_CHECK(!reader.read(blob));
+  }
+  BOOST_REQUIRE(!raw.empty());
+
+  // Raw blobs come after buffers written before them.
+  {
+    const osmium::io::File file(file_name);
+    const osmium::io::Header header;
+    blob_writer writer(file, header);
+    writer(nodes(1, 3));
+    writer.write_raw(std::move(raw));
+    writer(nodes(7, 9));
+    writer.close();
+  }
+
+  osmium::io::Reader reader(file_name);
+  osmium::object_id_type next = 1;
+  while(osmium::memory::Buffer buffer = reader.read()){
+    for(const auto& node: buffer.select<osmium::Node>()){
+      BOOST_CHECK_EQUAL(node.id(), next);
+      BOOST_CHECK(node.location() == location(next));
+      ++next;
+    }
+  }
+  reader.close();
+  BOOST_CHECK_EQUAL(next, 10);
+  std::remove(raw_name.c_str());
+  std::remove(file_name.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(geojson_checks)
+
+BOOST_AUTO_TEST_CASE(read_extracts_groups_outputs){
+  const std::string file_name = "read_extracts_checks.geojson";
+  const std::string square = "[[[0, 0], [1, 0], [1, 1], [0, 1], [0, 0]]]";
+  auto feature = [&](const std::string& type,
+                     const std::string& coordinates,
+                     const std::string& output){
+    return "{\"type\": \"Feature\", \"properties\": {\"output\": \"" + output
+      + "\"}, \"geometry\": {\"type\": \"" + type
+      + "\", \"coordinates\": " + coordinates + "}}";
+  };
+  {
+    std::ofstream geojson(file_name);
+    geojson << "{\"type\": \"FeatureCollection\", \"features\": ["
+            << feature("Polygon", square, "a.osm.pbf") << ", "
+            << feature("MultiPolygon", "[" + square + ", " + square + "]", "b.osm") << ", "
+            << feature("Point", "[0, 0]", "c.osm") << ", "
+            << feature("Polygon", square, "a.osm.pbf")
+            << "]}";
+  }
+
+  std::vector<std::string> outputs;
+  std::vector<std::unique_ptr<polygon_set>> polygon_sets;
+  std::string error_msg;
+  BOOST_CHECK(read_extracts(file_name, outputs, polygon_sets, error_msg));
+  BOOST_CHECK(outputs == std::vector<std::string>({"a.osm.pbf", "b.osm"}));
+  BOOST_REQUIRE_EQUAL(polygon_sets.size(), 2);
+  BOOST_CHECK_EQUAL(polygon_sets[0]->size(), 2);
+  BOOST_CHECK_EQUAL(polygon_sets[0]->name(1), "feature_3");
+  BOOST_CHECK_EQUAL(polygon_sets[1]->size(), 2);
+  BOOST_CHECK_EQUAL(polygon_sets[1]->name(1), "feature_1_1");
+
+  // All polygon features need an output.
+  {
+    std::ofstream geojson(file_name);
+    geojson << "{\"features\": [{\"geometry\": {\"type\": \"Polygon\", \"coordinates\": "
+            << square << "}}]}";
+  }
+  outputs.clear();
+  polygon_sets.clear();
+  BOOST_CHECK(!read_extracts(file_name, outputs, polygon_sets, error_msg));
+  std::remove(file_name.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
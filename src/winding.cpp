@@ -0,0 +1,233 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#include "winding.h"
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define WINDING_SIMD
+#include <immintrin.h>
+#endif
+
+void edge_arrays::push_back(int32_t x_1, int32_t y_1, int32_t x_2, int32_t y_2){
+  x1.push_back(x_1);
+  y1.push_back(y_1);
+  x2.push_back(x_2);
+  y2.push_back(y_2);
+}
+
+std::size_t edge_arrays::size() const{
+  return x1.size();
+}
+
+int edge_arrays::winding_number(std::size_t first,
+                                std::size_t last,
+                                const osmium::Location& loc) const{
+  return ::winding_number(x1.data() + first,
+                          y1.data() + first,
+                          x2.data() + first,
+                          y2.data() + first,
+                          last - first,
+                          loc.x(),
+                          loc.y());
+}
+
+// Coordinate differences wrap around as int32_t values, just like
+// in check_left, so that products never overflow int64_t.
+inline int64_t difference(int32_t a, int32_t b){
+  return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+}
+
+int scalar_winding_number(const int32_t* x1,
+                          const int32_t* y1,
+                          const int32_t* x2,
+                          const int32_t* y2,
+                          std::size_t n,
+                          int32_t x,
+                          int32_t y){
+  int wn = 0;
+  for(std::size_t i = 0; i < n; ++i){
+    const int64_t cross = difference(x2[i], x1[i]) * difference(y, y1[i])
+      - difference(y2[i], y1[i]) * difference(x, x1[i]);
+    if(y1[i] <= y){
+      wn += ((y2[i] > y) and (cross > 0));
+    }
+    else{
+      wn -= ((y2[i] <= y) and (cross < 0));
+    }
+  }
+  return wn;
+}
+
+#ifdef WINDING_SIMD
+
+// Eight edges per iteration. Crossing predicates are evaluated as
+// lane masks (all bits set for true), cross products are computed
+// separately for even and odd lanes as exact int64_t values.
+__attribute__((target("avx2")))
+int avx2_winding_number(const int32_t* x1,
+                        const int32_t* y1,
+                        const int32_t* x2,
+                        const int32_t* y2,
+                        std::size_t n,
+                        int32_t x,
+                        int32_t y){
+  const __m256i loc_x = _mm256_set1_epi32(x);
+  const __m256i loc_y = _mm256_set1_epi32(y);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i wn = zero;
+
+  std::size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    const __m256i a_x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x1 + i));
+    const __m256i a_y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y1 + i));
+    const __m256i b_x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x2 + i));
+    const __m256i b_y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y2 + i));
+
+    const __m256i a_above = _mm256_cmpgt_epi32(a_y, loc_y);
+    const __m256i b_above = _mm256_cmpgt_epi32(b_y, loc_y);
+    const __m256i upward = _mm256_andnot_si256(a_above, b_above);
+    const __m256i downward = _mm256_andnot_si256(b_above, a_above);
+
+    const __m256i u_1 = _mm256_sub_epi32(b_x, a_x);
+    const __m256i u_2 = _mm256_sub_epi32(b_y, a_y);
+    const __m256i v_1 = _mm256_sub_epi32(loc_x, a_x);
+    const __m256i v_2 = _mm256_sub_epi32(loc_y, a_y);
+
+    const __m256i cross_even = _mm256_sub_epi64(_mm256_mul_epi32(u_1, v_2),
+                                                _mm256_mul_epi32(u_2, v_1));
+    const __m256i cross_odd
+      = _mm256_sub_epi64(_mm256_mul_epi32(_mm256_srli_epi64(u_1, 32),
+                                          _mm256_srli_epi64(v_2, 32)),
+                         _mm256_mul_epi32(_mm256_srli_epi64(u_2, 32),
+                                          _mm256_srli_epi64(v_1, 32)));
+
+    const __m256i left = _mm256_blend_epi32(_mm256_cmpgt_epi64(cross_even, zero),
+                                            _mm256_cmpgt_epi64(cross_odd, zero),
+                                            0xAA);
+    const __m256i right = _mm256_blend_epi32(_mm256_cmpgt_epi64(zero, cross_even),
+                                             _mm256_cmpgt_epi64(zero, cross_odd),
+                                             0xAA);
+
+    // Masks are -1 for true.
+    wn = _mm256_sub_epi32(wn, _mm256_and_si256(upward, left));
+    wn = _mm256_add_epi32(wn, _mm256_and_si256(downward, right));
+  }
+
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(wn),
+                              _mm256_extracti128_si256(wn, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+  return _mm_cvtsi128_si32(sum)
+    + scalar_winding_number(x1 + i, y1 + i, x2 + i, y2 + i, n - i, x, y);
+}
+
+// Same as above with four edges per iteration.
+__attribute__((target("sse4.2")))
+int sse42_winding_number(const int32_t* x1,
+                         const int32_t* y1,
+                         const int32_t* x2,
+                         const int32_t* y2,
+                         std::size_t n,
+                         int32_t x,
+                         int32_t y){
+  const __m128i loc_x = _mm_set1_epi32(x);
+  const __m128i loc_y = _mm_set1_epi32(y);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i wn = zero;
+
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4){
+    const __m128i a_x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x1 + i));
+    const __m128i a_y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y1 + i));
+    const __m128i b_x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x2 + i));
+    const __m128i b_y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y2 + i));
+
+    const __m128i a_above = _mm_cmpgt_epi32(a_y, loc_y);
+    const __m128i b_above = _mm_cmpgt_epi32(b_y, loc_y);
+    const __m128i upward = _mm_andnot_si128(a_above, b_above);
+    const __m128i downward = _mm_andnot_si128(b_above, a_above);
+
+    const __m128i u_1 = _mm_sub_epi32(b_x, a_x);
+    const __m128i u_2 = _mm_sub_epi32(b_y, a_y);
+    const __m128i v_1 = _mm_sub_epi32(loc_x, a_x);
+    const __m128i v_2 = _mm_sub_epi32(loc_y, a_y);
+
+    const __m128i cross_even = _mm_sub_epi64(_mm_mul_epi32(u_1, v_2),
+                                             _mm_mul_epi32(u_2, v_1));
+    const __m128i cross_odd
+      = _mm_sub_epi64(_mm_mul_epi32(_mm_srli_epi64(u_1, 32),
+                                    _mm_srli_epi64(v_2, 32)),
+                      _mm_mul_epi32(_mm_srli_epi64(u_2, 32),
+                                    _mm_srli_epi64(v_1, 32)));
+
+    const __m128i left = _mm_blend_epi16(_mm_cmpgt_epi64(cross_even, zero),
+                                         _mm_cmpgt_epi64(cross_odd, zero),
+                                         0xCC);
+    const __m128i right = _mm_blend_epi16(_mm_cmpgt_epi64(zero, cross_even),
+                                          _mm_cmpgt_epi64(zero, cross_odd),
+                                          0xCC);
+
+    wn = _mm_sub_epi32(wn, _mm_and_si128(upward, left));
+    wn = _mm_add_epi32(wn, _mm_and_si128(downward, right));
+  }
+
+  __m128i sum = _mm_add_epi32(wn, _mm_shuffle_epi32(wn, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+  return _mm_cvtsi128_si32(sum)
+    + scalar_winding_number(x1 + i, y1 + i, x2 + i, y2 + i, n - i, x, y);
+}
+
+#endif
+
+typedef int (*winding_kernel)(const int32_t*,
+                              const int32_t*,
+                              const int32_t*,
+                              const int32_t*,
+                              std::size_t,
+                              int32_t,
+                              int32_t);
+
+struct kernel_choice{
+  winding_kernel kernel;
+  const char* name;
+};
+
+kernel_choice select_kernel(){
+#ifdef WINDING_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    return {avx2_winding_number, "avx2"};
+  }
+  if(__builtin_cpu_supports("sse4.2")){
+    return {sse42_winding_number, "sse4.2"};
+  }
+#endif
+  return {scalar_winding_number, "scalar"};
+}
+
+const kernel_choice& current_kernel(){
+  static const kernel_choice choice = select_kernel();
+  return choice;
+}
+
+int winding_number(const int32_t* x1,
+                   const int32_t* y1,
+                   const int32_t* x2,
+                   const int32_t* y2,
+                   std::size_t n,
+                   int32_t x,
+                   int32_t y){
+  return current_kernel().kernel(x1, y1, x2, y2, n, x, y);
+}
+
+const char* winding_kernel_name(){
+  return current_kernel().name;
+}
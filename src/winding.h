@@ -0,0 +1,106 @@
+/*
+
+This file is part of osmium-polygon.
+
+Copyright (c) 2016-2017, Julien Coupey.
+All rights reserved (see LICENSE).
+
+*/
+
+#ifndef WINDING_H
+#define WINDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <osmium/osm/location.hpp>
+
+// Uses the (l1l2)x(l1l0) cross product z-component to check the
+// relative position between l0 and the oriented line defined by l1
+// and l2.
+//
+// Return a positive (resp. negative) value if l0 is left
+// (resp. right) of the oriented line through l1 and l2. 0 if l0 is on
+// the line.
+inline int64_t check_left(const osmium::Location& l0,
+                          const osmium::Location& l1,
+                          const osmium::Location& l2){
+  // Use int32_t version of coordinates with member function x and y to
+  // avoid floating point precision issues. Cast the values to int64_t
+  // to avoid overflows for initial int32_t values.
+  int64_t u_1 = static_cast<int64_t>(l2.x() - l1.x());
+  int64_t u_2 = static_cast<int64_t>(l2.y() - l1.y());
+  int64_t v_1 = static_cast<int64_t>(l0.x() - l1.x());
+  int64_t v_2 = static_cast<int64_t>(l0.y() - l1.y());
+
+  return u_1 * v_2 - u_2 * v_1;
+}
+
+// Contribution of the edge from l1 to l2 to the winding number of
+// l0, see http://geomalgorithms.com/a03-_inclusion.html.
+inline int edge_winding(const osmium::Location& l0,
+                        const osmium::Location& l1,
+                        const osmium::Location& l2){
+  if(l1.y() <= l0.y()){
+    if((l2.y() > l0.y()) and (check_left(l0, l1, l2) > 0)){
+      // Upward crossing with l0 on the left of edge from l1 to l2,
+      // gives a valid up intersect.
+      return 1;
+    }
+  }
+  else{
+    if((l2.y() <= l0.y()) and (check_left(l0, l1, l2) < 0)){
+      // Downward crossing with l0 on the right of edge from l1 to
+      // l2, gives a valid down intersect.
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Winding number of (x, y) with regard to the n edges from (x1[i],
+// y1[i]) to (x2[i], y2[i]). Gives the same result as summing
+// edge_winding over all edges, using a vectorized kernel selected at
+// runtime depending on CPU support.
+int winding_number(const int32_t* x1,
+                   const int32_t* y1,
+                   const int32_t* x2,
+                   const int32_t* y2,
+                   std::size_t n,
+                   int32_t x,
+                   int32_t y);
+
+// Portable fallback for the above.
+int scalar_winding_number(const int32_t* x1,
+                          const int32_t* y1,
+                          const int32_t* x2,
+                          const int32_t* y2,
+                          std::size_t n,
+                          int32_t x,
+                          int32_t y);
+
+// Name of the kernel used by winding_number.
+const char* winding_kernel_name();
+
+// Inclusion status shared by all locations in a box, boundary
+// meaning that some locations may be inside and others outside.
+enum class box_position{outside, inside, boundary};
+
+// Edge lists stored as separate coordinate arrays.
+struct edge_arrays{
+  std::vector<int32_t> x1;
+  std::vector<int32_t> y1;
+  std::vector<int32_t> x2;
+  std::vector<int32_t> y2;
+
+  void push_back(int32_t x_1, int32_t y_1, int32_t x_2, int32_t y_2);
+
+  std::size_t size() const;
+
+  // Winding number of loc with regard to edges in [first, last).
+  int winding_number(std::size_t first,
+                     std::size_t last,
+                     const osmium::Location& loc) const;
+};
+
+#endif